@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Collect the microbenchmark results of tests/unit and compare them to a baseline.
+
+Usage:
+  bench_report.py <log> [<log> ...]                  print the results as JSON
+  bench_report.py -                                  read the log from stdin
+  bench_report.py <log> --baseline <json> [--threshold <percent>]
+                                                     fail on regressions
+
+A log is the console output of the test, e.g. twister-out/native_posix/
+tests/unit/app.unit/handler.log or the output of running zephyr.exe directly.
+Every BENCH line holds one JSON object with name, iterations, ns_per_op and
+bytes_per_op. With a baseline (the JSON this script printed earlier) the exit
+status is 1 when ns_per_op grew by more than the threshold, default 10%, or
+when bytes_per_op changed.
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = "BENCH "
+
+
+def parse(lines):
+    results = {}
+    for line in lines:
+        index = line.find(PREFIX)
+        if index < 0:
+            continue
+        result = json.loads(line[index + len(PREFIX):])
+        results[result["name"]] = result
+    return results
+
+
+def compare(results, baseline, threshold):
+    regressions = []
+    print("%-20s %12s %12s %8s %8s" % ("name", "baseline ns", "ns", "change", "bytes"))
+    for name, result in sorted(results.items()):
+        base = baseline.get(name)
+        if base is None:
+            print("%-20s %12s %12.3f %8s %8d" % (name, "-", result["ns_per_op"], "new",
+                                                result["bytes_per_op"]))
+            continue
+        change = (result["ns_per_op"] / base["ns_per_op"] - 1) * 100 if base["ns_per_op"] else 0
+        print("%-20s %12.3f %12.3f %+7.1f%% %8d" % (name, base["ns_per_op"], result["ns_per_op"],
+                                                   change, result["bytes_per_op"]))
+        if change > threshold:
+            regressions.append("%s: %+.1f%% ns/op" % (name, change))
+        if result["bytes_per_op"] != base["bytes_per_op"]:
+            regressions.append("%s: %d bytes/op, was %d" % (name, result["bytes_per_op"],
+                                                            base["bytes_per_op"]))
+    return regressions
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("logs", nargs="+", help="console logs, - for stdin")
+    parser.add_argument("--baseline", help="results of an earlier run")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed ns/op increase in percent")
+    args = parser.parse_args(argv)
+
+    results = {}
+    for log in args.logs:
+        if log == "-":
+            results.update(parse(sys.stdin))
+        else:
+            with open(log, errors="replace") as f:
+                results.update(parse(f))
+    if not results:
+        print("error: no BENCH lines found", file=sys.stderr)
+        return 1
+
+    if not args.baseline:
+        print(json.dumps(results, indent=2, sort_keys=True))
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    regressions = compare(results, baseline, args.threshold)
+    for regression in regressions:
+        print("regression: %s" % regression, file=sys.stderr)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
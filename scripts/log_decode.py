@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Host-side renderer for dictionary logging (overlay-log-dictionary.conf).
+
+Usage:
+  log_decode.py <build dir> <capture>    decode a binary RTT capture file
+  log_decode.py <build dir> -            decode a binary capture read from stdin
+
+The device only sends format string addresses and raw arguments. They are
+rendered with the Zephyr dictionary parser ($ZEPHYR_BASE/scripts/logging/dictionary)
+and the database the build writes to <build dir>/zephyr/log_dictionary.json.
+A capture can be taken with e.g. JLinkRTTLogger -Device NRF52840_XXAA -RTTChannel 0.
+"""
+
+import os
+import sys
+
+DATABASE = os.path.join("zephyr", "log_dictionary.json")
+
+
+def load_parser(build_dir):
+    zephyr_base = os.environ.get("ZEPHYR_BASE")
+    if not zephyr_base:
+        raise RuntimeError("ZEPHYR_BASE is not set, source zephyr-env.sh first")
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "logging", "dictionary"))
+
+    import dictionary_parser
+    from dictionary_parser.log_database import LogDatabase
+
+    path = os.path.join(build_dir, DATABASE)
+    database = LogDatabase.read_json_database(path)
+    if database is None:
+        raise RuntimeError("cannot read %s, build with overlay-log-dictionary.conf" % path)
+
+    parser = dictionary_parser.get_parser(database)
+    if parser is None:
+        raise RuntimeError("unsupported dictionary database version")
+    return parser
+
+
+def main(argv):
+    if len(argv) != 2 or argv[0] in ("-h", "--help"):
+        print(__doc__)
+        return 0 if argv and argv[0] in ("-h", "--help") else 1
+
+    try:
+        parser = load_parser(argv[0])
+    except (ImportError, RuntimeError) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+    if argv[1] == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(argv[1], "rb") as f:
+            data = f.read()
+
+    return 0 if parser.parse_log_data(data) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""Host-side decoder for the CBOR publication payload produced by
+src/payload.c (CONFIG_MQTT_SNCLIENT_PAYLOAD_CBOR).
+
+Usage:
+  payload_decode.py <hex> [<hex> ...]    decode payloads given as hex
+  payload_decode.py -                    decode hex payloads, one per line on stdin
+  payload_decode.py --compare            compare CBOR and JSON sizes for a sample record
+
+Only the subset of CBOR emitted by the device is supported.
+"""
+
+import json
+import struct
+import sys
+
+# Keys must stay in sync with enum payloadKey in src/payload.h
+FIELDS = {
+    0: ("id", lambda v: v.hex()),
+    1: ("count", int),
+    2: ("status", str),
+    3: ("batt", int),
+    4: ("lat", lambda v: v / 1e7),
+    5: ("lon", lambda v: v / 1e7),
+    6: ("ele", lambda v: v / 100),
+    7: ("temp", lambda v: v / 100),
+    10: ("peer", lambda v: None if not v else ":".join("%02x" % b for b in reversed(v))),
+}
+
+# Batches carry the ID once and records as positional arrays in key order.
+# Records after the first hold deltas to the previous one, null when unchanged.
+KEY_ID = 0
+KEY_RECORDS = 8
+KEY_PEER = 10
+RECORD_KEYS = (1, 2, 3, 4, 5, 6, 7, KEY_PEER)
+
+# Diagnostics carry the ID and a positional array of counters
+KEY_DIAG = 9
+DIAG_FIELDS = ("uptime", "published", "failed", "retransmits", "searches", "stored")
+
+
+class DecodeError(Exception):
+    pass
+
+
+def _head(data, pos):
+    if pos >= len(data):
+        raise DecodeError("truncated at offset %d" % pos)
+    major = data[pos] >> 5
+    info = data[pos] & 0x1F
+    pos += 1
+    if info < 24:
+        return major, info, pos
+    sizes = {24: 1, 25: 2, 26: 4, 27: 8}
+    if info not in sizes:
+        if info == 31:
+            return major, None, pos
+        raise DecodeError("unsupported additional info %d" % info)
+    n = sizes[info]
+    if pos + n > len(data):
+        raise DecodeError("truncated at offset %d" % pos)
+    return major, int.from_bytes(data[pos:pos + n], "big"), pos + n
+
+
+def _item(data, pos):
+    major, value, pos = _head(data, pos)
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major == 7 and value == 22:
+        return None, pos
+    if major in (2, 3):
+        raw = bytes(data[pos:pos + value])
+        if len(raw) != value:
+            raise DecodeError("truncated string at offset %d" % pos)
+        return (raw if major == 2 else raw.decode("utf-8")), pos + value
+    if major == 4:
+        items = []
+        if value is None:
+            while data[pos] != 0xFF:
+                item, pos = _item(data, pos)
+                items.append(item)
+            return items, pos + 1
+        for _ in range(value):
+            item, pos = _item(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        out = {}
+        for _ in range(value):
+            key, pos = _item(data, pos)
+            out[key], pos = _item(data, pos)
+        return out, pos
+    raise DecodeError("unsupported major type %d" % major)
+
+
+def _record(raw):
+    out = {}
+    for key, value in raw.items():
+        name, conv = FIELDS.get(key, (str(key), lambda v: v))
+        out[name] = conv(value)
+    return out
+
+
+def decode(data):
+    item, pos = _item(bytearray(data), 0)
+    if pos != len(data):
+        raise DecodeError("%d trailing bytes" % (len(data) - pos))
+    if isinstance(item, dict) and KEY_DIAG in item:
+        out = {"id": item[KEY_ID].hex()}
+        out.update(zip(DIAG_FIELDS, item[KEY_DIAG]))
+        return out
+    if isinstance(item, dict) and KEY_RECORDS in item:
+        records = []
+        prev = None
+        for values in item[KEY_RECORDS]:
+            raw = {KEY_ID: item[KEY_ID]}
+            for key, value in zip(RECORD_KEYS, values):
+                if prev is not None:
+                    if value is None:
+                        value = prev[key]
+                    elif isinstance(value, int):
+                        value += prev[key]
+                raw[key] = value
+            records.append(_record(raw))
+            prev = raw
+        return records
+    return _record(item)
+
+
+def _encode_head(major, value):
+    if value < 24:
+        return bytes([(major << 5) | value])
+    if value <= 0xFF:
+        return bytes([(major << 5) | 24, value])
+    if value <= 0xFFFF:
+        return bytes([(major << 5) | 25]) + struct.pack(">H", value)
+    return bytes([(major << 5) | 26]) + struct.pack(">I", value)
+
+
+def _encode_int(value):
+    return _encode_head(0, value) if value >= 0 else _encode_head(1, -1 - value)
+
+
+def encode(record):
+    out = _encode_head(5, 9)
+    out += _encode_int(0) + _encode_head(2, 8) + record["id"]
+    out += _encode_int(1) + _encode_int(record["count"])
+    status = record["status"].encode()
+    out += _encode_int(2) + _encode_head(3, len(status)) + status
+    out += _encode_int(3) + _encode_int(record["batt"])
+    out += _encode_int(4) + _encode_int(record["lat"])
+    out += _encode_int(5) + _encode_int(record["lon"])
+    out += _encode_int(6) + _encode_int(record["ele"])
+    out += _encode_int(7) + _encode_int(record["temp"])
+    out += _encode_int(KEY_PEER) + _encode_peer(record.get("peer"))
+    return out
+
+
+def _encode_peer(peer, prev=None):
+    peer = peer or b""
+    if prev is not None and peer == prev:
+        return bytes([0xF6])
+    return _encode_head(2, len(peer)) + peer
+
+
+def encode_batch(records):
+    out = _encode_head(5, 2)
+    out += _encode_int(KEY_ID) + _encode_head(2, 8) + records[0]["id"]
+    out += _encode_int(KEY_RECORDS) + _encode_head(4, len(records))
+    prev = None
+    for record in records:
+        out += _encode_head(4, 8)
+        for name in ("count", "status", "batt", "lat", "lon", "ele", "temp", "peer"):
+            value = record.get(name)
+            if name == "peer":
+                out += _encode_peer(value, (prev.get(name) or b"") if prev else None)
+            elif name == "status":
+                if prev is not None and value == prev[name]:
+                    out += bytes([0xF6])
+                else:
+                    out += _encode_head(3, len(value)) + value.encode()
+            else:
+                out += _encode_int(value - (prev[name] if prev else 0))
+        prev = record
+    return out
+
+
+def encode_json(record):
+    temp = record["temp"]
+    return ('{"id":"%s","count":%d,"status":"%s","batt":%d,"lat":%d,"lon":%d,'
+            '"ele":%d,"temp":%s%d.%02d,"peer":"%s"}' % (
+                record["id"].hex(), record["count"], record["status"], record["batt"],
+                record["lat"], record["lon"], record["ele"],
+                "-" if temp < 0 else "", abs(temp) // 100, abs(temp) % 100,
+                bytes(reversed(record.get("peer", bytes(6)))).hex())).encode()
+
+
+def compare():
+    samples = [
+        ("idle", dict(id=bytes(range(8)), count=0, status="P1", batt=100,
+                      lat=0, lon=0, ele=0, temp=2400)),
+        ("fix", dict(id=bytes(range(8)), count=12345, status="P1", batt=87,
+                     lat=515074000, lon=-1278000, ele=3512, temp=2150)),
+    ]
+    print("%-6s %6s %6s %7s" % ("record", "json", "cbor", "saving"))
+    for name, record in samples:
+        j = len(encode_json(record))
+        c = len(encode(record))
+        assert decode(encode(record))["count"] == record["count"]
+        print("%-6s %6d %6d %6d%%" % (name, j, c, 100 - (100 * c) // j))
+    records = [dict(samples[1][1], count=12345 + i, lat=515074000 + 3 * i) for i in range(4)]
+    batch = encode_batch(records)
+    assert [r["count"] for r in decode(batch)] == [r["count"] for r in records]
+    print("batch of %d: %d bytes (%d per record)" % (len(records), len(batch), len(batch) // len(records)))
+
+
+def main(argv):
+    if not argv or argv[0] in ("-h", "--help"):
+        print(__doc__)
+        return 0
+    if argv[0] == "--compare":
+        compare()
+        return 0
+    lines = sys.stdin.read().split() if argv[0] == "-" else argv
+    status = 0
+    for line in lines:
+        try:
+            print(json.dumps(decode(bytes.fromhex(line.replace(":", "")))))
+        except (ValueError, DecodeError) as e:
+            print("error: %s" % e, file=sys.stderr)
+            status = 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
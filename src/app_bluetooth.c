@@ -5,6 +5,7 @@
 
 #include <zephyr/logging/log.h>
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/hci.h>
@@ -15,15 +16,131 @@
 #include <bluetooth/gatt_dm.h>
 #include <bluetooth/scan.h>
 #include "bluetooth/lns_client.h"
+#include "boot.h"
 
 // Definitions
 
+/* Handles of a bonded tag, valid as long as its Database Hash is unchanged */
+struct lns_handle_cache {
+	struct bt_lns_handles handles;
+	uint8_t db_hash[16];
+};
+
+#define LNS_CACHE_KEY_PREFIX "lns/h"
+/* Prefix, separator, address in hex and address type */
+#define LNS_CACHE_KEY_LEN (sizeof(LNS_CACHE_KEY_PREFIX) + 1 + 12 + 1)
+
+/* One LNS client per link, the table is full when every connection is used */
+struct lns_peer {
+	struct bt_conn *conn;
+	struct bt_lns_client lns;
+	/* Waiting for its turn in the discovery manager */
+	bool discover_pending;
+	/* MTU, data length and PHY were requested for this connection */
+	bool upgraded;
+	struct bt_gatt_exchange_params mtu_params;
+	/* Connection parameters in use, interval in 1.25 ms units */
+	uint16_t interval;
+	uint16_t latency;
+	uint8_t phy;
+	/* Notification counters at the start of the rate window */
+	int64_t rate_start;
+	uint32_t rate_count;
+	uint32_t rate_bytes;
+	/* Radio time per second estimated over the last rate window */
+	uint32_t radio_us;
+	/* Handle cache entry of a bonded tag, and why its hash is read */
+	struct lns_handle_cache cache;
+	struct bt_gatt_read_params hash_params;
+	bool hash_validate;
+	/* This connection skipped discovery */
+	bool cached;
+	int64_t connect_time;
+	bool notified;
+};
+
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+/* Values are taken from advertising data, scan requests are not needed */
+#define SCAN_TYPE BT_SCAN_TYPE_SCAN_PASSIVE
+
+/* Last value accepted from a tag, direct mapped by address */
+struct adv_seen {
+	bt_addr_le_t addr;
+	uint32_t hash;
+	uint32_t time;
+};
+#else
+/* This demo doesn't require active scan */
+#define SCAN_TYPE BT_SCAN_TYPE_SCAN_ACTIVE
+#endif
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/* Link layer preamble, access address, header and CRC of every packet */
+#define LL_PACKET_OVERHEAD 10
+/* L2CAP and ATT headers in front of a notified value */
+#define ATT_NOTIFY_OVERHEAD 7
+#define LL_IFS_US 150
+
 // Statics
 
 LOG_MODULE_REGISTER(app_bluetooth, CONFIG_APP_BLUETOOTH_LOG_LEVEL);
 
-static struct bt_conn *default_conn;
-static struct bt_lns_client lns;
+static struct lns_peer peers[CONFIG_BT_MAX_CONN];
+
+/* The discovery manager handles a single procedure at a time */
+static struct lns_peer *discovering;
+
+/* Ring the sample consumer takes from next, the advertising ring comes last */
+static size_t sample_ring_next;
+
+/* Scanning is held off while Thread has the radio */
+static atomic_t scan_paused;
+
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_APP_BLUETOOTH_ADV_RING_SIZE),
+	     "CONFIG_APP_BLUETOOTH_ADV_RING_SIZE must be a power of two");
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_APP_BLUETOOTH_ADV_TAGS),
+	     "CONFIG_APP_BLUETOOTH_ADV_TAGS must be a power of two");
+
+static struct bt_lns_sample adv_samples[CONFIG_APP_BLUETOOTH_ADV_RING_SIZE];
+static struct bt_lns_ring adv_ring;
+static struct adv_seen adv_seen[CONFIG_APP_BLUETOOTH_ADV_TAGS];
+
+/* Only written from the Bluetooth RX context */
+static struct {
+	uint32_t values;
+	uint32_t duplicates;
+	uint32_t malformed;
+} adv_stats;
+
+/* Every report is needed, the controller filter would hide changed values */
+static struct bt_le_scan_param adv_scan_param = {
+	.type = BT_LE_SCAN_TYPE_PASSIVE,
+	.options = BT_LE_SCAN_OPT_NONE,
+	.interval = BT_GAP_SCAN_FAST_INTERVAL,
+	.window = BT_GAP_SCAN_FAST_WINDOW,
+};
+#endif
+
+/* Connection to first value, with and without discovery */
+static uint32_t first_notify_discovered_ms;
+static uint32_t first_notify_cached_ms;
+
+static struct {
+	int64_t start;
+	uint32_t count;
+	uint32_t bytes;
+	uint32_t rate_milli;
+	uint32_t bytes_per_sec;
+} throughput;
+
+static void throughput_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(throughput_work, throughput_handler);
+
+static void link_adapt_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(link_adapt_work, link_adapt_handler);
 
 // Prototypes
 
@@ -32,12 +149,234 @@ static struct bt_lns_client lns;
 static void notify_location_and_speed_cb(struct bt_lns_client *lns,
 				    struct ble_lns_loc_speed_s *lns_data);
 
+static struct lns_peer *peer_find(const struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		if (peers[i].conn == conn) {
+			return &peers[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct lns_peer *peer_add(struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		if (!peers[i].conn) {
+			struct lns_peer *peer = &peers[i];
+
+			peer->conn = bt_conn_ref(conn);
+			peer->discover_pending = false;
+			peer->upgraded = false;
+			peer->interval = 0;
+			peer->latency = 0;
+			peer->phy = BT_GAP_LE_PHY_1M;
+			peer->cached = false;
+			peer->notified = false;
+			peer->rate_start = k_uptime_get();
+			peer->rate_count = atomic_get(&peer->lns.notify_count);
+			peer->rate_bytes = atomic_get(&peer->lns.notify_bytes);
+			peer->radio_us = 0;
+			return peer;
+		}
+	}
+
+	return NULL;
+}
+
+static void peer_remove(struct lns_peer *peer)
+{
+	/* The ring is kept, samples taken before the link dropped still go out */
+	bt_lns_client_reset(&peer->lns);
+
+	bt_conn_unref(peer->conn);
+	peer->conn = NULL;
+	peer->discover_pending = false;
+}
+
+static size_t peer_count(void)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		if (peers[i].conn) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* Keep scanning for further tags as long as a connection is free */
+static void scan_resume(void)
+{
+	int err;
+
+	/* The coexistence scheduler restarts it with the next BLE window */
+	if (atomic_get(&scan_paused)) {
+		return;
+	}
+
+	if (peer_count() >= ARRAY_SIZE(peers)) {
+		LOG_INF("Connection table full, scanning stopped");
+		return;
+	}
+
+	err = bt_scan_start(SCAN_TYPE);
+	if (err && err != -EALREADY) {
+		LOG_WRN("Scanning failed to start (err %d)", err);
+	}
+}
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+/**
+ * @brief Queue a Location and Speed value from advertising data.
+ *
+ * Tags repeat the same value in every advertising event until it
+ * changes. A value is dropped when the tag sent the same one within
+ * CONFIG_APP_BLUETOOTH_ADV_DEDUP_MS. Tags sharing a table entry only
+ * cost an occasional duplicate.
+ */
+static void adv_ingest_value(const bt_addr_le_t *addr, const uint8_t *data,
+			     uint16_t length)
+{
+	struct adv_seen *seen = &adv_seen[fnv1a(FNV_OFFSET_BASIS, addr, sizeof(*addr)) &
+					  (ARRAY_SIZE(adv_seen) - 1)];
+	uint32_t hash = fnv1a(FNV_OFFSET_BASIS, data, length);
+	uint32_t now = k_uptime_get_32();
+	int err;
+
+	if (seen->hash == hash && !bt_addr_le_cmp(&seen->addr, addr) &&
+	    now - seen->time < CONFIG_APP_BLUETOOTH_ADV_DEDUP_MS) {
+		adv_stats.duplicates++;
+		return;
+	}
+
+	err = bt_lns_ring_put(&adv_ring, addr, data, length);
+	if (err == -EINVAL) {
+		adv_stats.malformed++;
+		return;
+	} else if (err) {
+		/* Counted as overrun, a repeat of the value may still get in */
+		return;
+	}
+
+	adv_stats.values++;
+	bt_addr_le_copy(&seen->addr, addr);
+	seen->hash = hash;
+	seen->time = now;
+}
+
+static bool adv_data_cb(struct bt_data *data, void *user_data)
+{
+	const bt_addr_le_t *addr = user_data;
+
+	if (data->type != BT_DATA_SVC_DATA16 || data->data_len < sizeof(uint16_t) ||
+	    sys_get_le16(data->data) != BT_UUID_LNS_VAL) {
+		return true;
+	}
+
+	/* LNS service data carries the Location and Speed characteristic value */
+	adv_ingest_value(addr, data->data + sizeof(uint16_t),
+			 data->data_len - sizeof(uint16_t));
+
+	return false;
+}
+
+static void adv_ingest(const bt_addr_le_t *addr, struct net_buf_simple *ad)
+{
+	struct net_buf_simple_state state;
+
+	/* Parsing consumes the buffer, other scan users still need it */
+	net_buf_simple_save(ad, &state);
+	bt_data_parse(ad, adv_data_cb, (void *)addr);
+	net_buf_simple_restore(ad, &state);
+}
+
+#if defined(CONFIG_BT_PER_ADV_SYNC)
+static void per_adv_synced(struct bt_le_per_adv_sync *sync,
+			   struct bt_le_per_adv_sync_synced_info *info)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	bt_addr_le_to_str(info->addr, addr, sizeof(addr));
+	LOG_INF("Synced to periodic advertising of %s", addr);
+}
+
+static void per_adv_term(struct bt_le_per_adv_sync *sync,
+			 const struct bt_le_per_adv_sync_term_info *info)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	bt_addr_le_to_str(info->addr, addr, sizeof(addr));
+	LOG_INF("Periodic advertising sync to %s lost (reason %u)", addr,
+		info->reason);
+}
+
+static void per_adv_recv(struct bt_le_per_adv_sync *sync,
+			 const struct bt_le_per_adv_sync_recv_info *info,
+			 struct net_buf_simple *buf)
+{
+	adv_ingest(info->addr, buf);
+}
+
+static struct bt_le_per_adv_sync_cb per_adv_cb = {
+	.synced = per_adv_synced,
+	.term = per_adv_term,
+	.recv = per_adv_recv,
+};
+
+/* Follow the periodic train of a tag, sync slots limit how many at once */
+static void per_adv_follow(const struct bt_le_scan_recv_info *info)
+{
+	struct bt_le_per_adv_sync_param param = { 0 };
+	struct bt_le_per_adv_sync *sync;
+	int err;
+
+	if (!info->interval) {
+		return;
+	}
+
+	bt_addr_le_copy(&param.addr, info->addr);
+	param.sid = info->sid;
+	/* Give up after five missed events, in 10 ms units */
+	param.timeout = CLAMP(info->interval * 5 * 5 / 4 / 10, 0x000A, 0x4000);
+
+	err = bt_le_per_adv_sync_create(&param, &sync);
+	if (err) {
+		/* Already synced, another sync pending or no sync left */
+		LOG_DBG("No periodic advertising sync (err %d)", err);
+	}
+}
+#endif /* CONFIG_BT_PER_ADV_SYNC */
+#endif /* CONFIG_APP_BLUETOOTH_ADV_INGEST */
+
 static void scan_filter_match(struct bt_scan_device_info *device_info,
 			      struct bt_scan_filter_match *filter_match,
 			      bool connectable)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
 
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+	adv_ingest(device_info->recv_info->addr, device_info->adv_data);
+#if defined(CONFIG_BT_PER_ADV_SYNC)
+	per_adv_follow(device_info->recv_info);
+#endif
+	return;
+#endif
+
 	bt_addr_le_to_str(device_info->recv_info->addr, addr, sizeof(addr));
 
 	LOG_INF("Filters matched. Address: %s connectable: %s",
@@ -47,12 +386,18 @@ static void scan_filter_match(struct bt_scan_device_info *device_info,
 static void scan_connecting_error(struct bt_scan_device_info *device_info)
 {
 	LOG_WRN("Connecting failed");
+
+	scan_resume();
 }
 
 static void scan_connecting(struct bt_scan_device_info *device_info,
 			    struct bt_conn *conn)
 {
-	default_conn = bt_conn_ref(conn);
+	if (!peer_add(conn)) {
+		/* Scanning is stopped before the table fills, so this is a bug */
+		LOG_ERR("No free LNS peer");
+		bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	}
 }
 
 static void scan_filter_no_match(struct bt_scan_device_info *device_info,
@@ -62,6 +407,15 @@ static void scan_filter_no_match(struct bt_scan_device_info *device_info,
 	struct bt_conn *conn;
 	char addr[BT_ADDR_LE_STR_LEN];
 
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+	/* Tags that only send service data do not carry the UUID filtered on */
+	adv_ingest(device_info->recv_info->addr, device_info->adv_data);
+#if defined(CONFIG_BT_PER_ADV_SYNC)
+	per_adv_follow(device_info->recv_info);
+#endif
+	return;
+#endif
+
 	if (device_info->recv_info->adv_type == BT_GAP_ADV_TYPE_ADV_DIRECT_IND) {
 		bt_addr_le_to_str(device_info->recv_info->addr, addr,
 				  sizeof(addr));
@@ -73,8 +427,14 @@ static void scan_filter_no_match(struct bt_scan_device_info *device_info,
 					device_info->conn_param, &conn);
 
 		if (!err) {
-			default_conn = bt_conn_ref(conn);
+			if (!peer_add(conn)) {
+				LOG_ERR("No free LNS peer");
+				bt_conn_disconnect(conn,
+						   BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+			}
 			bt_conn_unref(conn);
+		} else {
+			scan_resume();
 		}
 	}
 }
@@ -82,22 +442,17 @@ static void scan_filter_no_match(struct bt_scan_device_info *device_info,
 BT_SCAN_CB_INIT(scan_cb, scan_filter_match, scan_filter_no_match,
 		scan_connecting_error, scan_connecting);
 
-static void discovery_completed_cb(struct bt_gatt_dm *dm,
-				   void *context)
+static void discovery_next(void);
+static void discovery_done(void *context);
+static void gatt_discover(struct bt_conn *conn);
+
+/* Subscribe, or poll tags that cannot notify */
+static void lns_start(struct lns_peer *peer)
 {
 	int err;
 
-	LOG_INF("The discovery procedure succeeded");
-
-	bt_gatt_dm_data_print(dm);
-
-	err = bt_lns_handles_assign(dm, &lns);
-	if (err) {
-		LOG_WRN("Could not init LNS client object, error: %d", err);
-	}
-
-	if (bt_lns_notify_supported(&lns)) {
-		err = bt_lns_subscribe_location_and_speed(&lns,
+	if (bt_lns_notify_supported(&peer->lns)) {
+		err = bt_lns_subscribe_location_and_speed(&peer->lns,
 						     notify_location_and_speed_cb);
 		if (err) {
 			LOG_WRN("Cannot subscribe to LNS value notification "
@@ -106,23 +461,188 @@ static void discovery_completed_cb(struct bt_gatt_dm *dm,
 		}
 	} else {
 		err = bt_lns_start_per_read_location_and_speed(
-			&lns, LNS_READ_VALUE_INTERVAL, notify_location_and_speed_cb);
+			&peer->lns, LNS_READ_VALUE_INTERVAL, notify_location_and_speed_cb);
 		if (err) {
 			LOG_WRN("Could not start periodic read of LNS value");
 		}
 	}
+}
+
+static void cache_key(char *key, const bt_addr_le_t *addr)
+{
+	snprintk(key, LNS_CACHE_KEY_LEN, LNS_CACHE_KEY_PREFIX "/%02x%02x%02x%02x%02x%02x%u",
+		 addr->a.val[5], addr->a.val[4], addr->a.val[3],
+		 addr->a.val[2], addr->a.val[1], addr->a.val[0], addr->type);
+}
+
+static int cache_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+			 void *cb_arg, void *param)
+{
+	struct lns_handle_cache *cache = param;
+
+	/* Only the exact key, nothing below it */
+	if (key || len != sizeof(*cache)) {
+		return 0;
+	}
+
+	if (read_cb(cb_arg, cache, sizeof(*cache)) != sizeof(*cache)) {
+		cache->handles.val_handle = 0;
+	}
+
+	return 0;
+}
+
+static void cache_delete(const bt_addr_le_t *addr)
+{
+	char key[LNS_CACHE_KEY_LEN];
+
+	cache_key(key, addr);
+	settings_delete(key);
+}
+
+static void db_hash_result(struct lns_peer *peer, const uint8_t *hash)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(peer->conn);
+	char key[LNS_CACHE_KEY_LEN];
+	int err;
+
+	cache_key(key, addr);
+
+	if (!peer->hash_validate) {
+		if (!hash) {
+			LOG_INF("No Database Hash, handles are not cached");
+			return;
+		}
+
+		bt_lns_handles_get(&peer->lns, &peer->cache.handles);
+		memcpy(peer->cache.db_hash, hash, sizeof(peer->cache.db_hash));
+		err = settings_save_one(key, &peer->cache, sizeof(peer->cache));
+		if (err) {
+			LOG_WRN("Could not store the LNS handles (err %d)", err);
+		}
+		return;
+	}
+
+	if (hash && !memcmp(hash, peer->cache.db_hash, sizeof(peer->cache.db_hash)) &&
+	    !bt_lns_handles_restore(&peer->lns, peer->conn, &peer->cache.handles)) {
+		LOG_INF("GATT database unchanged, using cached handles");
+		peer->cached = true;
+		lns_start(peer);
+		return;
+	}
+
+	LOG_INF("GATT database changed, discovering again");
+	settings_delete(key);
+	gatt_discover(peer->conn);
+}
+
+static uint8_t db_hash_read_cb(struct bt_conn *conn, uint8_t err,
+			       struct bt_gatt_read_params *params,
+			       const void *data, uint16_t length)
+{
+	struct lns_peer *peer = CONTAINER_OF(params, struct lns_peer, hash_params);
+
+	if (peer->conn != conn) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	/* Errors, including a peer without the characteristic, end without data */
+	db_hash_result(peer, (!err && data && length == sizeof(peer->cache.db_hash)) ?
+			     data : NULL);
+
+	return BT_GATT_ITER_STOP;
+}
+
+/**
+ * @brief Read the Database Hash of a bonded tag.
+ *
+ * The hash changes whenever the tag's services change, which covers what
+ * a Service Changed indication would tell us without subscribing to it.
+ *
+ * @param peer     LNS peer.
+ * @param validate Check the cached handles rather than store new ones.
+ *
+ * @retval 0 If the read was started.
+ */
+static int db_hash_read(struct lns_peer *peer, bool validate)
+{
+	peer->hash_validate = validate;
+	peer->hash_params.func = db_hash_read_cb;
+	peer->hash_params.handle_count = 0;
+	peer->hash_params.by_uuid.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	peer->hash_params.by_uuid.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	peer->hash_params.by_uuid.uuid = BT_UUID_GATT_DB_HASH;
+
+	return bt_gatt_read(peer->conn, &peer->hash_params);
+}
+
+/* Start from the cached handles of a bonded tag once its hash is confirmed */
+static bool cache_lookup(struct lns_peer *peer)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(peer->conn);
+	char key[LNS_CACHE_KEY_LEN];
+	int err;
+
+	if (!bt_addr_le_is_bonded(BT_ID_DEFAULT, addr)) {
+		return false;
+	}
+
+	memset(&peer->cache, 0, sizeof(peer->cache));
+	cache_key(key, addr);
+	err = settings_load_subtree_direct(key, cache_load_cb, &peer->cache);
+	if (err || !peer->cache.handles.val_handle) {
+		return false;
+	}
+
+	err = db_hash_read(peer, true);
+	if (err) {
+		LOG_WRN("Database Hash read failed (err %d)", err);
+		return false;
+	}
+
+	return true;
+}
+
+static void discovery_completed_cb(struct bt_gatt_dm *dm,
+				   void *context)
+{
+	struct lns_peer *peer = context;
+	int err;
+
+	LOG_INF("The discovery procedure succeeded");
+
+	bt_gatt_dm_data_print(dm);
+
+	/* The link may have gone down while the procedure was running */
+	err = (peer->conn == bt_gatt_dm_conn_get(dm)) ?
+	      bt_lns_handles_assign(dm, &peer->lns) : -ENOTCONN;
+	if (err) {
+		LOG_WRN("Could not init LNS client object, error: %d", err);
+	} else {
+		lns_start(peer);
+
+		/* Bonded tags keep their handles, remember them for the next connection */
+		if (bt_addr_le_is_bonded(BT_ID_DEFAULT, bt_conn_get_dst(peer->conn)) &&
+		    db_hash_read(peer, false)) {
+			LOG_WRN("Database Hash read failed");
+		}
+	}
 
 	err = bt_gatt_dm_data_release(dm);
 	if (err) {
 		LOG_WRN("Could not release the discovery data, error "
 		       "code: %d", err);
 	}
+
+	discovery_done(context);
 }
 
 static void discovery_service_not_found_cb(struct bt_conn *conn,
 					   void *context)
 {
 	LOG_WRN("The service could not be found during the discovery");
+
+	discovery_done(context);
 }
 
 static void discovery_error_found_cb(struct bt_conn *conn,
@@ -130,6 +650,8 @@ static void discovery_error_found_cb(struct bt_conn *conn,
 				     void *context)
 {
 	LOG_WRN("The discovery procedure failed with %d", err);
+
+	discovery_done(context);
 }
 
 static struct bt_gatt_dm_cb discovery_cb = {
@@ -138,21 +660,215 @@ static struct bt_gatt_dm_cb discovery_cb = {
 	.error_found = discovery_error_found_cb,
 };
 
-static void gatt_discover(struct bt_conn *conn)
+/**
+ * @brief Start discovery on the next link waiting for it.
+ *
+ * Links are discovered one after the other, in table order.
+ */
+static void discovery_next(void)
 {
 	int err;
 
-	if (conn != default_conn) {
+	while (!discovering) {
+		struct lns_peer *peer = NULL;
+
+		for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+			if (peers[i].conn && peers[i].discover_pending) {
+				peer = &peers[i];
+				break;
+			}
+		}
+
+		if (!peer) {
+			return;
+		}
+
+		err = bt_gatt_dm_start(peer->conn, BT_UUID_LNS, &discovery_cb, peer);
+		if (err == -EALREADY) {
+			/* Still held by a procedure that has not called back yet,
+			 * the link stays pending until it does
+			 */
+			return;
+		}
+
+		peer->discover_pending = false;
+
+		if (err) {
+			LOG_WRN("Could not start the discovery procedure, error "
+			       "code: %d", err);
+			/* Without discovery the link is of no use, drop it */
+			bt_conn_disconnect(peer->conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+			continue;
+		}
+
+		discovering = peer;
+	}
+}
+
+/**
+ * @brief Release the discovery manager after a procedure called back.
+ *
+ * @param context The link the procedure was started for.
+ */
+static void discovery_done(void *context)
+{
+	if (context != discovering) {
 		return;
 	}
 
-	err = bt_gatt_dm_start(conn, BT_UUID_LNS, &discovery_cb, NULL);
+	discovering = NULL;
+	discovery_next();
+}
+
+static void mtu_exchange_cb(struct bt_conn *conn, uint8_t err,
+			    struct bt_gatt_exchange_params *params)
+{
 	if (err) {
-		LOG_WRN("Could not start the discovery procedure, error "
-		       "code: %d", err);
+		LOG_WRN("MTU exchange failed (err %u)", err);
+	} else {
+		LOG_INF("ATT MTU %u", bt_gatt_get_mtu(conn));
 	}
 }
 
+/**
+ * @brief Request a larger ATT MTU, data length and the 2M PHY.
+ *
+ * A notification then fits one link layer packet and takes half the air
+ * time. Done once per connection, after security so the requests do not
+ * collide with pairing.
+ */
+static void link_upgrade(struct lns_peer *peer)
+{
+	int err;
+
+	if (peer->upgraded) {
+		return;
+	}
+
+	peer->upgraded = true;
+
+	peer->mtu_params.func = mtu_exchange_cb;
+	err = bt_gatt_exchange_mtu(peer->conn, &peer->mtu_params);
+	if (err) {
+		LOG_WRN("MTU exchange failed to start (err %d)", err);
+	}
+
+	err = bt_conn_le_data_len_update(peer->conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		LOG_WRN("Data length update failed (err %d)", err);
+	}
+
+	err = bt_conn_le_phy_update(peer->conn, BT_CONN_LE_PHY_PARAM_2M);
+	if (err) {
+		LOG_WRN("PHY update failed (err %d)", err);
+	}
+}
+
+/**
+ * @brief Estimate the radio time a link takes in microseconds per second.
+ *
+ * The central sends in every connection event whatever the peripheral
+ * latency, so each event costs an empty exchange. Notifications add their
+ * headers and value to the peripheral packet.
+ */
+static uint32_t link_radio_us(const struct lns_peer *peer, uint32_t notifications,
+			      uint32_t bytes, uint32_t elapsed_ms)
+{
+	uint32_t byte_us = (peer->phy == BT_GAP_LE_PHY_2M) ? 4 : 8;
+	uint32_t event_us = 2 * LL_PACKET_OVERHEAD * byte_us + LL_IFS_US;
+	uint64_t data_us = ((uint64_t)notifications * ATT_NOTIFY_OVERHEAD + bytes) * byte_us;
+
+	if (!peer->interval || !elapsed_ms) {
+		return 0;
+	}
+
+	/* 800 events per second at an interval of one 1.25 ms unit */
+	return 800 * event_us / peer->interval + data_us * MSEC_PER_SEC / elapsed_ms;
+}
+
+/**
+ * @brief Fit the connection parameters to the notification rate of a tag.
+ *
+ * The interval follows the notification period within the configured
+ * bounds, so the link does not hold the radio for empty events that
+ * 802.15.4 could use. Tags slower than the longest interval get
+ * peripheral latency to skip the events in between. Parameters are only
+ * renegotiated when the interval moves by more than a quarter.
+ */
+static void link_adapt(struct lns_peer *peer, int64_t now)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+	uint32_t count = atomic_get(&peer->lns.notify_count);
+	uint32_t bytes = atomic_get(&peer->lns.notify_bytes);
+	uint32_t elapsed = now - peer->rate_start;
+	uint32_t notifications = count - peer->rate_count;
+	uint32_t period_ms, interval_ms, latency, timeout_ms, radio_us;
+	uint16_t interval;
+	int err;
+
+	radio_us = link_radio_us(peer, notifications, bytes - peer->rate_bytes, elapsed);
+	peer->radio_us = radio_us;
+
+	peer->rate_start = now;
+	peer->rate_count = count;
+	peer->rate_bytes = bytes;
+
+	bt_addr_le_to_str(bt_conn_get_dst(peer->conn), addr, sizeof(addr));
+	LOG_INF("%s: %u notifications in %u s, interval %u.%02u ms, latency %u, "
+		"radio duty %u.%02u%%", addr, notifications, elapsed / MSEC_PER_SEC,
+		peer->interval * 5 / 4, (peer->interval * 125) % 100, peer->latency,
+		radio_us / 10000, (radio_us / 100) % 100);
+
+	period_ms = notifications ? elapsed / notifications : elapsed;
+	interval_ms = CLAMP(period_ms, APP_BLUETOOTH_CONN_INTERVAL_MIN_MS,
+			    APP_BLUETOOTH_CONN_INTERVAL_MAX_MS);
+	latency = (period_ms > interval_ms) ?
+		  MIN(period_ms / interval_ms - 1, APP_BLUETOOTH_CONN_LATENCY_MAX) : 0;
+	/* Six missed windows before the link is considered lost */
+	timeout_ms = CLAMP(interval_ms * (1 + latency) * 6, 100, 32000);
+	interval = interval_ms * 4 / 5;
+
+	if (peer->interval && latency == peer->latency &&
+	    4 * (uint32_t)ABS(interval - peer->interval) <= peer->interval) {
+		return;
+	}
+
+	struct bt_le_conn_param param = BT_LE_CONN_PARAM_INIT(interval, interval,
+							      latency, timeout_ms / 10);
+
+	err = bt_conn_le_param_update(peer->conn, &param);
+	if (err) {
+		LOG_WRN("%s: connection parameter update failed (err %d)", addr, err);
+	}
+}
+
+static void link_adapt_handler(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		/* Rates are only meaningful once the tag is subscribed */
+		if (peers[i].conn && peers[i].upgraded && !peers[i].discover_pending &&
+		    discovering != &peers[i]) {
+			link_adapt(&peers[i], now);
+		}
+	}
+
+	k_work_schedule(&link_adapt_work, K_MSEC(APP_BLUETOOTH_LINK_ADAPT_INTERVAL_MS));
+}
+
+static void gatt_discover(struct bt_conn *conn)
+{
+	struct lns_peer *peer = peer_find(conn);
+
+	if (!peer) {
+		return;
+	}
+
+	peer->discover_pending = true;
+	discovery_next();
+}
+
 static void connected(struct bt_conn *conn, uint8_t conn_err)
 {
 	int err;
@@ -162,25 +878,40 @@ static void connected(struct bt_conn *conn, uint8_t conn_err)
 
 	if (conn_err) {
 		LOG_WRN("Failed to connect to %s (%u)", addr, conn_err);
-		if (conn == default_conn) {
-			bt_conn_unref(default_conn);
-			default_conn = NULL;
-
-			/* This demo doesn't require active scan */
-			err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-			if (err) {
-				LOG_WRN("Scanning failed to start (err %d)",
-				       err);
-			}
+		struct lns_peer *peer = peer_find(conn);
+
+		if (peer) {
+			peer_remove(peer);
+			scan_resume();
 		}
 
 		return;
 	}
 
+	LOG_INF("Connected: %s, %u of %u links", addr, (unsigned int)peer_count(),
+		CONFIG_BT_MAX_CONN);
+
+	struct lns_peer *peer = peer_find(conn);
+	struct bt_conn_info info;
+
+	if (peer && !bt_conn_get_info(conn, &info)) {
+		peer->interval = info.le.interval;
+		peer->latency = info.le.latency;
+	}
+
+	if (peer) {
+		peer->connect_time = k_uptime_get();
+	}
+
+	scan_resume();
+
 	err = bt_conn_set_security(conn, BT_SECURITY_L2);
 	if (err) {
 		LOG_WRN("Failed to set security: %d", err);
 
+		if (peer) {
+			link_upgrade(peer);
+		}
 		gatt_discover(conn);
 	}
 }
@@ -188,24 +919,21 @@ static void connected(struct bt_conn *conn, uint8_t conn_err)
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
-	int err;
+	struct lns_peer *peer = peer_find(conn);
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
 	LOG_WRN("Disconnected: %s (reason %u)", addr, reason);
 
-	if (default_conn != conn) {
+	if (!peer) {
 		return;
 	}
 
-	bt_conn_unref(default_conn);
-	default_conn = NULL;
+	peer_remove(peer);
 
-	/* This demo doesn't require active scan */
-	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-	if (err) {
-		LOG_WRN("Scanning failed to start (err %d)", err);
-	}
+	/* A link still being discovered is released by its callback */
+	discovery_next();
+	scan_resume();
 }
 
 static void security_changed(struct bt_conn *conn, bt_security_t level,
@@ -222,13 +950,61 @@ static void security_changed(struct bt_conn *conn, bt_security_t level,
 			err);
 	}
 
+	struct lns_peer *peer = peer_find(conn);
+
+	if (peer) {
+		link_upgrade(peer);
+
+		/* Reconnecting bonded tags skip discovery while their database is unchanged */
+		if (!err && cache_lookup(peer)) {
+			return;
+		}
+	}
+
 	gatt_discover(conn);
 }
 
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	struct lns_peer *peer = peer_find(conn);
+
+	LOG_INF("Connection parameters: interval %u.%02u ms, latency %u, timeout %u ms",
+		interval * 5 / 4, (interval * 125) % 100, latency, timeout * 10);
+
+	if (peer) {
+		peer->interval = interval;
+		peer->latency = latency;
+	}
+}
+
+static void le_phy_updated(struct bt_conn *conn,
+			   struct bt_conn_le_phy_info *param)
+{
+	struct lns_peer *peer = peer_find(conn);
+
+	LOG_INF("PHY updated: TX %u, RX %u", param->tx_phy, param->rx_phy);
+
+	if (peer) {
+		/* Notifications travel from the tag, its TX is our RX */
+		peer->phy = param->rx_phy;
+	}
+}
+
+static void le_data_len_updated(struct bt_conn *conn,
+				struct bt_conn_le_data_len_info *info)
+{
+	LOG_INF("Data length updated: TX %u bytes, RX %u bytes",
+		info->tx_max_len, info->rx_max_len);
+}
+
 BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.connected = connected,
 	.disconnected = disconnected,
-	.security_changed = security_changed
+	.security_changed = security_changed,
+	.le_param_updated = le_param_updated,
+	.le_phy_updated = le_phy_updated,
+	.le_data_len_updated = le_data_len_updated,
 };
 
 static void scan_init(void)
@@ -236,14 +1012,25 @@ static void scan_init(void)
 	int err;
 
 	struct bt_scan_init_param scan_init = {
-		.connect_if_match = 1,
+		.connect_if_match = !IS_ENABLED(CONFIG_APP_BLUETOOTH_ADV_INGEST),
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+		.scan_param = &adv_scan_param,
+#else
 		.scan_param = NULL,
+#endif
 		.conn_param = BT_LE_CONN_PARAM_DEFAULT
 	};
 
 	bt_scan_init(&scan_init);
 	bt_scan_cb_register(&scan_cb);
 
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+	bt_lns_ring_init(&adv_ring, adv_samples, ARRAY_SIZE(adv_samples));
+#if defined(CONFIG_BT_PER_ADV_SYNC)
+	bt_le_per_adv_sync_cb_register(&per_adv_cb);
+#endif
+#endif
+
 	err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID, BT_UUID_LNS);
 	if (err) {
 		LOG_WRN("Scanning filters cannot be set (err %d)", err);
@@ -267,8 +1054,22 @@ static void notify_location_and_speed_cb(struct bt_lns_client *lns,
 	if (lns_data == NULL) {
 		LOG_WRN("[%s] Speed and Location notification aborted", addr);
 	} else {
+		struct lns_peer *peer = CONTAINER_OF(lns, struct lns_peer, lns);
+
+		if (!peer->notified) {
+			uint32_t elapsed = k_uptime_get() - peer->connect_time;
+
+			peer->notified = true;
+			if (peer->cached) {
+				first_notify_cached_ms = elapsed;
+			} else {
+				first_notify_discovered_ms = elapsed;
+			}
+			LOG_INF("[%s] First value %u ms after connecting, %s", addr, elapsed,
+				peer->cached ? "cached handles" : "discovered");
+		}
 
-		LOG_INF("[%s] Speed and Location notification: Speed: %u, Lat: %d, Long: %d, Ele: %d",
+		LOG_DBG("[%s] Speed and Location notification: Speed: %u, Lat: %d, Long: %d, Ele: %d",
 		       addr, 
                lns_data->instant_speed,
                lns_data->latitude,
@@ -345,33 +1146,35 @@ static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
 }
 
 
+static void bond_deleted(uint8_t id, const bt_addr_le_t *peer)
+{
+	cache_delete(peer);
+}
+
 static struct bt_conn_auth_cb conn_auth_callbacks = {
 	.cancel = auth_cancel,
 };
 
 static struct bt_conn_auth_info_cb conn_auth_info_callbacks = {
 	.pairing_complete = pairing_complete,
-	.pairing_failed = pairing_failed
+	.pairing_failed = pairing_failed,
+	.bond_deleted = bond_deleted
 };
 
-int appbluetoothInit(void)
+/* Runs on the system work queue once the controller is up */
+static void bt_ready(int err)
 {
-    int err;
-
-	LOG_INF("Starting Bluetooth Central LNS example");
-    
-	bt_lns_client_init(&lns);
-
-	err = bt_enable(NULL);
 	if (err) {
-		LOG_WRN("Bluetooth init failed (err %d)\n", err);
-		return 0;
+		LOG_WRN("Bluetooth init failed (err %d)", err);
+		return;
 	}
 
 	LOG_INF("Bluetooth initialized");
+	bootMark(BOOT_BLUETOOTH_READY);
 
+	/* Only the Bluetooth subtree, MQTT-SN loads its own in parallel */
 	if (IS_ENABLED(CONFIG_SETTINGS)) {
-		settings_load();
+		settings_load_subtree("bt");
 	}
 
 	scan_init();
@@ -379,24 +1182,168 @@ int appbluetoothInit(void)
 	err = bt_conn_auth_cb_register(&conn_auth_callbacks);
 	if (err) {
 		LOG_WRN("Failed to register authorization callbacks.");
-		return 0;
+		return;
 	}
 
 	err = bt_conn_auth_info_cb_register(&conn_auth_info_callbacks);
 	if (err) {
 		LOG_WRN("Failed to register authorization info callbacks.");
-		return 0;
+		return;
 	}
 
-#if 0
-	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+	/* Held off if the coexistence scheduler already gave the radio to Thread */
+	scan_resume();
+
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+	LOG_INF("Scanning for LNS advertising data");
+#else
+	LOG_INF("Scanning for up to %u LNS peers", CONFIG_BT_MAX_CONN);
+#endif
+
+	throughput.start = k_uptime_get();
+	k_work_schedule(&throughput_work, K_MSEC(APP_BLUETOOTH_THROUGHPUT_INTERVAL_MS));
+	k_work_schedule(&link_adapt_work, K_MSEC(APP_BLUETOOTH_LINK_ADAPT_INTERVAL_MS));
+}
+
+/* Returns right away, the controller comes up while Thread is started */
+int appbluetoothInit(void)
+{
+	int err;
+
+	LOG_INF("Starting Bluetooth Central LNS example");
+
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		bt_lns_client_init(&peers[i].lns);
+	}
+
+	err = bt_enable(bt_ready);
 	if (err) {
-		LOG_WRN("Scanning failed to start (err %d)", err);
-		return 0;
+		LOG_WRN("Bluetooth init failed (err %d)", err);
 	}
 
-	LOG_INF("Scanning successfully started\n");
+	return err;
+}
+
+/* Aggregate notification rate of all links over the last interval */
+static void throughput_handler(struct k_work *work)
+{
+	struct appbluetoothStats stats;
+	int64_t now = k_uptime_get();
+	uint32_t elapsed = now - throughput.start;
+
+	appbluetoothGetStats(&stats);
+
+	if (elapsed > 0) {
+		throughput.rate_milli = (uint64_t)(stats.notifications + stats.advValues -
+						   throughput.count) *
+					MSEC_PER_SEC * 1000 / elapsed;
+		throughput.bytes_per_sec = (uint64_t)(stats.bytes - throughput.bytes) *
+					   MSEC_PER_SEC / elapsed;
+	}
+
+	throughput.start = now;
+	throughput.count = stats.notifications + stats.advValues;
+	throughput.bytes = stats.bytes;
+
+	if (stats.peers) {
+		LOG_INF("%u peers: %u.%03u notifications/s, %u B/s, %u overruns, "
+			"%u cycles per notification (max %u)",
+			stats.peers, throughput.rate_milli / 1000,
+			throughput.rate_milli % 1000, throughput.bytes_per_sec,
+			stats.overruns, stats.notifyCyclesLast, stats.notifyCyclesMax);
+	}
+
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+	LOG_INF("Advertising: %u.%03u values/s, %u duplicates, %u malformed, %u overruns",
+		throughput.rate_milli / 1000, throughput.rate_milli % 1000,
+		stats.advDuplicates, stats.advMalformed, stats.overruns);
 #endif
 
-	return 0;
+	k_work_schedule(&throughput_work, K_MSEC(APP_BLUETOOTH_THROUGHPUT_INTERVAL_MS));
+}
+
+/* Rings of all links, followed by the advertising ring */
+static struct bt_lns_ring *sample_ring(size_t index)
+{
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+	if (index == ARRAY_SIZE(peers)) {
+		return &adv_ring;
+	}
+#endif
+
+	return &peers[index].lns.ring;
+}
+
+#define SAMPLE_RING_COUNT (ARRAY_SIZE(peers) + IS_ENABLED(CONFIG_APP_BLUETOOTH_ADV_INGEST))
+
+// Single consumer of the LNS sample rings, takes from them in turn
+int appbluetoothGetSample(struct bt_lns_sample *sample)
+{
+	for (size_t i = 0; i < SAMPLE_RING_COUNT; i++) {
+		struct bt_lns_ring *ring = sample_ring(sample_ring_next);
+
+		sample_ring_next = (sample_ring_next + 1) % SAMPLE_RING_COUNT;
+		if (bt_lns_ring_get(ring, sample) == 0) {
+			return 0;
+		}
+	}
+
+	return -ENODATA;
+}
+
+uint32_t appbluetoothGetOverruns(void)
+{
+	uint32_t overruns = 0;
+
+	for (size_t i = 0; i < SAMPLE_RING_COUNT; i++) {
+		overruns += atomic_get(&sample_ring(i)->overruns);
+	}
+
+	return overruns;
+}
+
+void appbluetoothGetStats(struct appbluetoothStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		if (peers[i].conn) {
+			stats->peers++;
+			stats->radioUs += peers[i].radio_us;
+		}
+		stats->notifications += atomic_get(&peers[i].lns.notify_count);
+		stats->bytes += atomic_get(&peers[i].lns.notify_bytes);
+		stats->notifyCyclesLast = MAX(stats->notifyCyclesLast,
+					      peers[i].lns.notify_cycles_last);
+		stats->notifyCyclesMax = MAX(stats->notifyCyclesMax,
+					     peers[i].lns.notify_cycles_max);
+	}
+
+	stats->overruns = appbluetoothGetOverruns();
+#if defined(CONFIG_APP_BLUETOOTH_ADV_INGEST)
+	stats->advValues = adv_stats.values;
+	stats->advDuplicates = adv_stats.duplicates;
+	stats->advMalformed = adv_stats.malformed;
+#endif
+	stats->rateMilli = throughput.rate_milli;
+	stats->firstNotifyDiscoveredMs = first_notify_discovered_ms;
+	stats->firstNotifyCachedMs = first_notify_cached_ms;
+	stats->bytesPerSec = throughput.bytes_per_sec;
+}
+
+void appbluetoothScanPause(bool paused)
+{
+	int err;
+
+	atomic_set(&scan_paused, paused);
+
+	if (!paused) {
+		scan_resume();
+		return;
+	}
+
+	err = bt_scan_stop();
+	if (err && err != -EALREADY) {
+		LOG_WRN("Scanning failed to stop (err %d)", err);
+	}
 }
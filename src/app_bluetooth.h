@@ -3,12 +3,43 @@
 
 // Includes
 
+#include "bluetooth/lns_client.h"
+
 // Defines
 
 #define LNS_READ_VALUE_INTERVAL 10000
+#define APP_BLUETOOTH_THROUGHPUT_INTERVAL_MS 60000
+
+// Connection parameters follow the notification rate of each tag
+#define APP_BLUETOOTH_LINK_ADAPT_INTERVAL_MS 30000
+#define APP_BLUETOOTH_CONN_INTERVAL_MIN_MS 15
+#define APP_BLUETOOTH_CONN_INTERVAL_MAX_MS 1000
+#define APP_BLUETOOTH_CONN_LATENCY_MAX 10
+
+struct appbluetoothStats
+{
+    uint32_t peers;         // Connected LNS peripherals
+    uint32_t notifications; // Notifications received from all peers
+    uint32_t bytes;
+    uint32_t overruns;      // Values dropped because a sample ring was full
+    uint32_t advValues;     // Values taken from advertising data
+    uint32_t advDuplicates; // Repeated advertising values dropped
+    uint32_t advMalformed;
+    uint32_t rateMilli;     // Notifications per second x1000 over the last interval
+    uint32_t bytesPerSec;
+    uint32_t notifyCyclesLast;  // Cycles to handle a notification, largest over all links
+    uint32_t notifyCyclesMax;
+    uint32_t firstNotifyDiscoveredMs;   // Connection to first value on the last link that ran discovery
+    uint32_t firstNotifyCachedMs;       // Same for the last link that used cached handles
+    uint32_t radioUs;       // Estimated radio time per second of all links
+};
 
 // Prototypes
 
 int appbluetoothInit(void);
+int appbluetoothGetSample(struct bt_lns_sample *sample);
+uint32_t appbluetoothGetOverruns(void);
+void appbluetoothGetStats(struct appbluetoothStats *stats);
+void appbluetoothScanPause(bool paused);
 
 #endif
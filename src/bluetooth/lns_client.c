@@ -8,11 +8,48 @@
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 
 #include "lns_client.h"
+#include "perf.h"
 
 LOG_MODULE_REGISTER(lns_client, CONFIG_LNS_CLIENT_LOG_LEVEL);
 
+/* Free running head and tail only index correctly across wrap for powers of two */
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_LNS_CLIENT_RING_SIZE),
+	     "CONFIG_LNS_CLIENT_RING_SIZE must be a power of two");
+
+/**
+ * @brief Get the ring slot for the next received value.
+ *
+ * The value is decoded straight into the slot, it only becomes visible
+ * to the consumer with @ref lns_ring_commit.
+ *
+ * @param ring Sample ring.
+ *
+ * @return Free slot or NULL if the ring is full.
+ */
+static struct bt_lns_sample *lns_ring_claim(struct bt_lns_ring *ring)
+{
+	atomic_val_t head = atomic_get(&ring->head);
+
+	if ((uint32_t)(head - atomic_get(&ring->tail)) >= ring->size) {
+		atomic_inc(&ring->overruns);
+		return NULL;
+	}
+
+	return &ring->samples[(uint32_t)head & (ring->size - 1)];
+}
+
+static void lns_ring_commit(struct bt_lns_ring *ring, struct bt_lns_sample *sample,
+			    const bt_addr_le_t *peer)
+{
+	sample->timestamp = k_uptime_get();
+	bt_addr_le_copy(&sample->peer, peer);
+	/* Atomic operations are full barriers, the slot is written before head moves */
+	atomic_inc(&ring->head);
+}
+
 /**
  * @brief Process location and speed value notification
  *
@@ -32,10 +69,15 @@ static uint8_t notify_process(struct bt_conn *conn,
 			   const void *data, uint16_t length)
 {
 	struct bt_lns_client *lns;
+	struct bt_lns_sample *sample;
 	const uint8_t *bdata = data;
-	struct ble_lns_loc_speed_s lns_data;
+	uint32_t start = k_cycle_get_32();
+	uint8_t ret = BT_GATT_ITER_CONTINUE;
+	int err;
 
-    LOG_INF("notify_process");
+	PERF_PROBE_BEGIN(PERF_LNS_NOTIFY);
+
+	LOG_DBG("notify_process");
 
 	lns = CONTAINER_OF(params, struct bt_lns_client, notify_params);
 	if (!data || !length) {
@@ -43,92 +85,55 @@ static uint8_t notify_process(struct bt_conn *conn,
 		if (lns->notify_location_and_speed_cb) {
 			lns->notify_location_and_speed_cb(lns, BT_LNS_VAL_INVALID);
 		}
-		return BT_GATT_ITER_STOP;
+		ret = BT_GATT_ITER_STOP;
+		goto out;
 	}
 
-	uint16_t flags = *((uint16_t *)&bdata[0]);
-    LOG_INF("Length: %d", length);
-    LOG_INF("Flags 0x%04X", flags);
-
-    LOG_INF("Data: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
-	 bdata[0], bdata[1], bdata[2], bdata[3], bdata[4], bdata[5], bdata[6], bdata[7], bdata[8], bdata[9]
-	);
-    LOG_INF("Data: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
-	 bdata[10], bdata[11], bdata[12], bdata[13], bdata[14], bdata[15], bdata[16], bdata[17], bdata[18], bdata[19]
-	);
-	
-	memset(&lns_data, 0, sizeof(struct ble_lns_loc_speed_s));
-
-	lns_data.instant_speed_present = (flags & 0x01) == 0x01;
-    lns_data.total_distance_present = (flags & 0x02) == 0x02;
-    lns_data.location_present = (flags & 0x04) == 0x04;
-    lns_data.elevation_present = (flags & 0x08) == 0x08;
-    lns_data.heading_present = (flags & 0x10) == 0x10;
-    lns_data.rolling_time_present = (flags & 0x20) == 0x20;
-    lns_data.utc_time_time_present = (flags & 0x40) == 0x40;
-
-	const uint8_t *pData = &bdata[2];
-
-	if(lns_data.instant_speed_present)
-	{
-		lns_data.instant_speed = *((uint16_t *)pData);
-		pData += 2;
+	LOG_DBG("Length: %d", length);
+	if (IS_ENABLED(CONFIG_LNS_CLIENT_HEXDUMP)) {
+		LOG_HEXDUMP_DBG(bdata, length, "Data:");
 	}
-	if(lns_data.total_distance_present)
-	{
-		// Ignore this for now
-		pData += 3;		
-	}
-	if(lns_data.location_present)
-	{
-		// Latitude - Unit is in degrees with a resolution of 1/(10^7)
-		lns_data.latitude = *((int32_t *)pData);
-		pData += 4;
 
-		// Longitude - Unit is in degrees with a resolution of 1/(10^7)
-		lns_data.longitude = *((int32_t *)pData);
-		pData += 4;
-	}
-	if(lns_data.elevation_present)
-	{
-		// Ignore this for now
-		pData += 3;
-	}
-	if(lns_data.heading_present)
-	{
-		lns_data.heading = *((uint16_t *)pData);
-		pData += 2;
-	}
-	if(lns_data.rolling_time_present)
-	{
-		lns_data.rolling_time = *((uint8_t *)pData);
-		pData += 1;
-	}
-	if(lns_data.utc_time_time_present)
-	{
-		// Smallest units in seconds
+	atomic_inc(&lns->notify_count);
+	atomic_add(&lns->notify_bytes, length);
 
-		// YYMMDDHHMMSS
-
-		// Ignore this for now
-	}
-
-	if (flags == BT_LNS_VAL_INVALID) {
+	if (length < sizeof(uint16_t) || sys_get_le16(bdata) == BT_LNS_VAL_INVALID) {
 		LOG_ERR("Unexpected notification value.");
 		if (lns->notify_location_and_speed_cb) {
 			lns->notify_location_and_speed_cb(lns, NULL);
 		}
-		return BT_GATT_ITER_STOP;
+		ret = BT_GATT_ITER_STOP;
+		goto out;
 	}
 
-	// Need to copy across LNS data here
-	memcpy(&lns->lns_data, &lns_data, sizeof(lns_data));
+	sample = lns_ring_claim(&lns->ring);
+	if (!sample) {
+		LOG_WRN("Sample ring full, notification dropped");
+		goto out;
+	}
+
+	/* Decoded straight into the ring */
+	err = bt_lns_parse_location_and_speed(bdata, length, &sample->data);
+	if (err) {
+		LOG_WRN("Truncated notification, %d bytes for flags 0x%04X",
+			length, sys_get_le16(bdata));
+		goto out;
+	}
 
 	if (lns->notify_location_and_speed_cb) {
-		lns->notify_location_and_speed_cb(lns, &lns_data);
+		lns->notify_location_and_speed_cb(lns, &sample->data);
 	}
 
-	return BT_GATT_ITER_CONTINUE;
+	lns_ring_commit(&lns->ring, sample, bt_conn_get_dst(lns->conn));
+
+out:
+	/* Every path, including the callback and whatever it logs */
+	lns->notify_cycles_last = k_cycle_get_32() - start;
+	lns->notify_cycles_max = MAX(lns->notify_cycles_max, lns->notify_cycles_last);
+
+	PERF_PROBE_END(PERF_LNS_NOTIFY);
+
+	return ret;
 }
 
 /**
@@ -151,31 +156,35 @@ static uint8_t read_process(struct bt_conn *conn, uint8_t err,
 			     const void *data, uint16_t length)
 {
 	struct bt_lns_client *lns;
-	uint16_t flags = BT_LNS_VAL_INVALID;
-	const uint8_t *bdata = data;
-
-    LOG_WRN("TODO: read_process");
+	struct bt_lns_sample *sample;
+	bt_lns_read_cb read_cb;
 
-#if 0
 	lns = CONTAINER_OF(params, struct bt_lns_client, read_params);
+	read_cb = lns->read_cb;
+	lns->read_cb = NULL;
 
-	if (!lns->read_cb) {
+	if (!read_cb) {
 		LOG_ERR("No read callback present");
-	} else  if (err) {
-		LOG_ERR("Read value error: %d", err);
-		lns->read_cb(lns,  flags, err);
-    }
-
-    LOG_INF("Length: %d", length);
-    LOG_INF("Flags 0x%04X", *((uint16_t *) data) );
+		return BT_GATT_ITER_STOP;
+	}
 
-	lns->flags = flags;
-			lns->read_cb(lns, flags, err);
-		}
+	if (err) {
+		LOG_ERR("Read value error: %d", err);
+		read_cb(lns, NULL, err);
+		return BT_GATT_ITER_STOP;
 	}
-#endif
 
-	lns->read_cb = NULL;
+	sample = lns_ring_claim(&lns->ring);
+	if (!sample) {
+		LOG_WRN("Sample ring full, read value dropped");
+		read_cb(lns, NULL, BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	} else if (bt_lns_parse_location_and_speed(data, length, &sample->data)) {
+		LOG_ERR("Unexpected read value size.");
+		read_cb(lns, NULL, BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	} else {
+		read_cb(lns, &sample->data, 0);
+		lns_ring_commit(&lns->ring, sample, bt_conn_get_dst(lns->conn));
+	}
 
 	return BT_GATT_ITER_STOP;
 }
@@ -202,9 +211,7 @@ static uint8_t periodic_read_process(struct bt_conn *conn, uint8_t err,
 {
 	int32_t interval;
 	struct bt_lns_client *lns;
-	const uint8_t *bdata = data;
-
-    LOG_WRN("TODO: periodic_read_process");
+	struct bt_lns_sample *sample;
 
 	lns = CONTAINER_OF(params, struct bt_lns_client,
 			periodic_read.params);
@@ -213,26 +220,14 @@ static uint8_t periodic_read_process(struct bt_conn *conn, uint8_t err,
 		LOG_ERR("No notification callback present");
 	} else  if (err) {
 		LOG_ERR("Read value error: %d", err);
-    }
-
-    LOG_INF("Length: %d", length);
-    LOG_INF("Flags 0x%04X", *((uint16_t *)data));
-
-#if 0
-	} else if (!data || length != 1) {
+	} else if (!(sample = lns_ring_claim(&lns->ring))) {
+		LOG_WRN("Sample ring full, read value dropped");
+	} else if (bt_lns_parse_location_and_speed(data, length, &sample->data)) {
 		LOG_ERR("Unexpected read value size.");
 	} else {
-		battery_level = bdata[0];
-		if (battery_level > BT_BAS_VAL_MAX) {
-			LOG_ERR("Unexpected read value.");
-		} else if (bas->battery_level != battery_level) {
-			bas->battery_level = battery_level;
-			bas->notify_cb(bas, battery_level);
-		} else {
-			/* Do nothing. */
-		}
+		lns->notify_location_and_speed_cb(lns, &sample->data);
+		lns_ring_commit(&lns->ring, sample, bt_conn_get_dst(lns->conn));
 	}
-#endif
 
 	interval = atomic_get(&lns->periodic_read.interval);
 	if (interval) {
@@ -253,7 +248,7 @@ static void lns_read_value_handler(struct k_work *work)
 	int err;
 	struct bt_lns_client *lns;
 
-    LOG_INF("lns_read_value_handler");
+	LOG_DBG("lns_read_value_handler");
 
 	lns = CONTAINER_OF(work, struct bt_lns_client,
 			     periodic_read.read_work);
@@ -296,7 +291,7 @@ static void lns_reinit(struct bt_lns_client *lns)
 
 	lns->ccc_handle = 0;
 	lns->val_handle = 0;
-	memset(&lns->lns_data, 0, sizeof(lns->lns_data));
+	/* The ring is kept, the consumer still owns its tail */
 	lns->conn = NULL;
 	lns->notify_location_and_speed_cb = NULL;
 	lns->read_cb = NULL;
@@ -304,13 +299,19 @@ static void lns_reinit(struct bt_lns_client *lns)
 }
 
 
+void bt_lns_client_reset(struct bt_lns_client *lns)
+{
+	bt_lns_stop_per_read_location_and_speed(lns);
+	lns_reinit(lns);
+}
+
 void bt_lns_client_init(struct bt_lns_client *lns)
 {
 	memset(lns, 0, sizeof(*lns));
 
     LOG_INF("lns_client_init");
 
-	memset(&lns->lns_data, 0, sizeof(struct ble_lns_loc_speed_s));
+	bt_lns_ring_init(&lns->ring, lns->samples, ARRAY_SIZE(lns->samples));
 
 	k_work_init_delayable(&lns->periodic_read.read_work,
 			      lns_read_value_handler);
@@ -374,6 +375,34 @@ int bt_lns_handles_assign(struct bt_gatt_dm *dm,
 	return 0;
 }
 
+void bt_lns_handles_get(const struct bt_lns_client *lns,
+			struct bt_lns_handles *handles)
+{
+	handles->val_handle = lns->val_handle;
+	handles->ccc_handle = lns->ccc_handle;
+	handles->properties = lns->properties;
+}
+
+int bt_lns_handles_restore(struct bt_lns_client *lns, struct bt_conn *conn,
+			   const struct bt_lns_handles *handles)
+{
+	if (!handles->val_handle) {
+		return -EINVAL;
+	}
+
+	/* Same as after discovery, a previous connection may still be reading */
+	k_work_cancel_delayable(&lns->periodic_read.read_work);
+	lns_reinit(lns);
+
+	lns->val_handle = handles->val_handle;
+	lns->ccc_handle = handles->ccc_handle;
+	lns->properties = handles->properties;
+	lns->notify = (handles->ccc_handle != 0);
+	lns->conn = conn;
+
+	return 0;
+}
+
 int bt_lns_subscribe_location_and_speed(struct bt_lns_client *lns,
 				   bt_lns_notify_location_and_speed_cb func)
 {
@@ -473,13 +502,52 @@ int bt_lns_read_location_and_speed(struct bt_lns_client *lns, bt_lns_read_cb fun
 }
 
 
-struct ble_lns_loc_speed_s *bt_lns_get_last_location_and_speed(struct bt_lns_client *lns)
+void bt_lns_ring_init(struct bt_lns_ring *ring, struct bt_lns_sample *samples,
+		      uint32_t size)
 {
-	if (!lns) {
-		return NULL;
+	__ASSERT(IS_POWER_OF_TWO(size), "Ring size must be a power of two");
+
+	memset(ring, 0, sizeof(*ring));
+	ring->samples = samples;
+	ring->size = size;
+}
+
+int bt_lns_ring_put(struct bt_lns_ring *ring, const bt_addr_le_t *peer,
+		    const uint8_t *data, uint16_t length)
+{
+	struct bt_lns_sample *sample = lns_ring_claim(ring);
+
+	if (!sample) {
+		return -ENOMEM;
+	}
+
+	if (bt_lns_parse_location_and_speed(data, length, &sample->data)) {
+		return -EINVAL;
 	}
 
-	return &lns->lns_data;
+	lns_ring_commit(ring, sample, peer);
+
+	return 0;
+}
+
+int bt_lns_ring_get(struct bt_lns_ring *ring, struct bt_lns_sample *sample)
+{
+	atomic_val_t tail = atomic_get(&ring->tail);
+
+	if (tail == atomic_get(&ring->head)) {
+		return -ENODATA;
+	}
+
+	*sample = ring->samples[(uint32_t)tail & (ring->size - 1)];
+	/* Slot is copied out before the producer may reuse it */
+	atomic_inc(&ring->tail);
+
+	return 0;
+}
+
+int bt_lns_get_sample(struct bt_lns_client *lns, struct bt_lns_sample *sample)
+{
+	return bt_lns_ring_get(&lns->ring, sample);
 }
 
 
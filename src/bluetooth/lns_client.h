@@ -6,28 +6,7 @@
 #ifndef __LNS_C_H
 #define __LNS_C_H
 
-struct ble_lns_loc_speed_s
-{
-    bool                            instant_speed_present;                     /**< Instantaneous Speed present (0=not present, 1=present). */
-    bool                            total_distance_present;                    /**< Total Distance present (0=not present, 1=present). */
-    bool                            location_present;                          /**< Location present (0=not present, 1=present). */
-    bool                            elevation_present;                         /**< Elevation present (0=not present, 1=present). */
-    bool                            heading_present;                           /**< Heading present (0=not present, 1=present). */
-    bool                            rolling_time_present;                      /**< Rolling Time present (0=not present, 1=present). */
-    bool                            utc_time_time_present;                     /**< UTC Time present (0=not present, 1=present). */
-//    ble_lns_pos_status_type_t       position_status;                           /**< Status of current position */
-//    ble_lns_speed_distance_format_t data_format;                               /**< Format of data (either 2D or 3D). */
-//    ble_lns_elevation_source_t      elevation_source;                          /**< Source of the elevation measurement. */
-//    ble_lns_heading_source_t        heading_source;                            /**< Source of the heading measurement. */
-    uint16_t                        instant_speed;                             /**< Instantaneous Speed (1/10 meter per sec). */
-    uint32_t                        total_distance;                            /**< Total Distance (meters), size=24 bits. */
-    int32_t                         latitude;                                  /**< Latitude (10e-7 degrees). */
-    int32_t                         longitude;                                 /**< Longitude (10e-7 degrees). */
-    int32_t                         elevation;                                 /**< Elevation (1/100 meters), size=24 bits. */
-    uint16_t                        heading;                                   /**< Heading (1/100 degrees). */
-    uint8_t                         rolling_time;                              /**< Rolling Time (seconds). */
-//    ble_date_time_t                 utc_time;                                  /**< UTC Time. */
-};
+#include "lns_parse.h"
 
 /**
  * @file
@@ -56,6 +35,35 @@ struct ble_lns_loc_speed_s
 
 struct bt_lns_client;
 
+/** @brief Location and speed value with its time of reception. */
+struct bt_lns_sample {
+	/** Uptime in milliseconds when the value was received. */
+	int64_t timestamp;
+	/** Address of the peer that sent the value. */
+	bt_addr_le_t peer;
+	/** Decoded value. */
+	struct ble_lns_loc_speed_s data;
+};
+
+/** @brief Single producer, single consumer ring of received values.
+ *
+ *  The Bluetooth RX context is the only producer and advances head,
+ *  the consumer (see @ref bt_lns_ring_get) is the only one advancing
+ *  tail. Values arriving while the ring is full are dropped and counted.
+ */
+struct bt_lns_ring {
+	/** Received values, indexed by free running counters. */
+	struct bt_lns_sample *samples;
+	/** Number of samples, a power of two. */
+	uint32_t size;
+	/** Count of values produced. */
+	atomic_t head;
+	/** Count of values consumed. */
+	atomic_t tail;
+	/** Values dropped because the ring was full. */
+	atomic_t overruns;
+};
+
 /**
  * @brief Value notification callback.
  *
@@ -84,6 +92,16 @@ typedef void (*bt_lns_read_cb)(struct bt_lns_client *lns,
 			       struct ble_lns_loc_speed_s *lns_data,
 			       int err);
 
+/** @brief Attribute handles of a peer, kept between connections. */
+struct bt_lns_handles {
+	/** Handle of the Location and Speed Characteristic value. */
+	uint16_t val_handle;
+	/** Handle of its CCCD, 0 if notifications are not supported. */
+	uint16_t ccc_handle;
+	/** Properties of the characteristic. */
+	uint8_t properties;
+};
+
 /* @brief LNS Client characteristic periodic read. */
 struct bt_lns_periodic_read {
 	/** Work queue used to measure the read interval. */
@@ -114,8 +132,18 @@ struct bt_lns_client {
 	uint16_t val_handle;
 	/** Handle of the CCCD of the Location and Speed Characteristic. */
 	uint16_t ccc_handle;
-	/** Current data */
-	struct ble_lns_loc_speed_s lns_data;
+	/** Received values waiting for the consumer. */
+	struct bt_lns_ring ring;
+	/** Storage of the ring. */
+	struct bt_lns_sample samples[CONFIG_LNS_CLIENT_RING_SIZE];
+	/** Notifications received, including dropped ones. */
+	atomic_t notify_count;
+	/** Bytes carried by the received notifications. */
+	atomic_t notify_bytes;
+	/** CPU cycles spent handling the last notification. */
+	uint32_t notify_cycles_last;
+	/** Most CPU cycles spent handling a notification. */
+	uint32_t notify_cycles_max;
 	/** Properties of the service. */
 	uint8_t properties;
 	/** Notification supported. */
@@ -132,6 +160,16 @@ struct bt_lns_client {
  */
 void bt_lns_client_init(struct bt_lns_client *bas);
 
+/**
+ * @brief Detach the LNS Client instance from its connection.
+ *
+ * Stops the periodic read and clears the connection, handles and
+ * callbacks. Samples already in the ring are kept.
+ *
+ * @param lns LNS Client object.
+ */
+void bt_lns_client_reset(struct bt_lns_client *lns);
+
 /**
  * @brief Assign handles to the LNS Client instance.
  *
@@ -152,6 +190,31 @@ void bt_lns_client_init(struct bt_lns_client *bas);
 int bt_lns_handles_assign(struct bt_gatt_dm *dm,
 			  struct bt_lns_client *lns);
 
+/**
+ * @brief Get the handles assigned to the LNS Client instance.
+ *
+ * @param lns     LNS Client object.
+ * @param handles Handles to be stored for the next connection.
+ */
+void bt_lns_handles_get(const struct bt_lns_client *lns,
+			struct bt_lns_handles *handles);
+
+/**
+ * @brief Assign previously discovered handles to the LNS Client instance.
+ *
+ * Used instead of @ref bt_lns_handles_assign when the peer database is
+ * known not to have changed since the handles were discovered.
+ *
+ * @param lns     LNS Client object.
+ * @param conn    Connection object.
+ * @param handles Handles from an earlier discovery.
+ *
+ * @retval 0 If the operation was successful.
+ * @retval -EINVAL If the handles are not valid.
+ */
+int bt_lns_handles_restore(struct bt_lns_client *lns, struct bt_conn *conn,
+			   const struct bt_lns_handles *handles);
+
 /**
  * @brief Subscribe to the Location And Speed change notification.
  *
@@ -200,17 +263,72 @@ struct bt_conn *bt_lns_conn(const struct bt_lns_client *lns);
 int bt_lns_read_location_and_speed(struct bt_lns_client *lns, bt_lns_read_cb func);
 
 /**
- * @brief Get the last known location and speed.
+ * @brief Initialize a sample ring.
+ *
+ * @param ring    Ring object.
+ * @param samples Storage for the samples.
+ * @param size    Number of samples, must be a power of two.
+ */
+void bt_lns_ring_init(struct bt_lns_ring *ring, struct bt_lns_sample *samples,
+		      uint32_t size);
+
+/**
+ * @brief Parse a Location and Speed value received outside of a connection.
+ *
+ * Used for values carried in advertising data. Must be called from the
+ * single producer context of the ring.
+ *
+ * @param ring   Ring the value is queued in.
+ * @param peer   Address of the sender.
+ * @param data   Location and Speed characteristic value.
+ * @param length Size of the value.
+ *
+ * @retval 0 If the value was queued.
+ * @retval -ENOMEM If the ring is full, the value is counted as overrun.
+ * @retval -EINVAL If the value is malformed.
+ */
+int bt_lns_ring_put(struct bt_lns_ring *ring, const bt_addr_le_t *peer,
+		    const uint8_t *data, uint16_t length);
+
+/**
+ * @brief Take the oldest value from a sample ring.
+ *
+ * Must only be called from a single consumer context. Never blocks.
  *
- * This function returns the last known location and seped value.
- * The location and speed is stored when a notification or read response is
- * received.
+ * @param ring   Ring object.
+ * @param sample Oldest value and its time of reception.
+ *
+ * @retval 0 If a value was taken.
+ * @retval -ENODATA If no value is waiting.
+ */
+int bt_lns_ring_get(struct bt_lns_ring *ring, struct bt_lns_sample *sample);
+
+/**
+ * @brief Take the oldest received location and speed value.
+ *
+ * Every value received by notification or read is queued, so no fix
+ * is lost between two calls unless the ring overruns. Must only be
+ * called from a single consumer context. Never blocks.
  *
  * @param lns LNS Client object.
+ * @param sample Oldest value and its time of reception.
  *
- * @return Location and speed or negative error code.
+ * @retval 0 If a value was taken.
+ * @retval -ENODATA If no value is waiting.
  */
-struct ble_lns_loc_speed_s *bt_lns_get_last_location_and_speed(struct bt_lns_client *lns);
+int bt_lns_get_sample(struct bt_lns_client *lns, struct bt_lns_sample *sample);
+
+/**
+ * @brief Get the number of values dropped because the ring was full.
+ *
+ * @param lns LNS Client object.
+ *
+ * @return Overrun count.
+ */
+static inline uint32_t bt_lns_get_overruns(const struct bt_lns_client *lns)
+{
+	return atomic_get(&lns->ring.overruns);
+}
 
 /**
  * @brief Check whether notification is supported by the service.
@@ -0,0 +1,113 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/sys/byteorder.h>
+
+#include "lns_parse.h"
+
+/** Optional field of the Location and Speed value, in wire order. */
+struct lns_field {
+	uint16_t flag;
+	uint8_t size;
+	void (*decode)(const uint8_t *src, struct ble_lns_loc_speed_s *dst);
+};
+
+static void decode_instant_speed(const uint8_t *src, struct ble_lns_loc_speed_s *dst)
+{
+	dst->instant_speed_present = true;
+	dst->instant_speed = sys_get_le16(src);
+}
+
+static void decode_total_distance(const uint8_t *src, struct ble_lns_loc_speed_s *dst)
+{
+	dst->total_distance_present = true;
+	dst->total_distance = sys_get_le24(src);
+}
+
+static void decode_location(const uint8_t *src, struct ble_lns_loc_speed_s *dst)
+{
+	dst->location_present = true;
+	dst->latitude = (int32_t)sys_get_le32(&src[0]);
+	dst->longitude = (int32_t)sys_get_le32(&src[4]);
+}
+
+static void decode_elevation(const uint8_t *src, struct ble_lns_loc_speed_s *dst)
+{
+	dst->elevation_present = true;
+	/* sint24, sign extend */
+	dst->elevation = (int32_t)(sys_get_le24(src) << 8) >> 8;
+}
+
+static void decode_heading(const uint8_t *src, struct ble_lns_loc_speed_s *dst)
+{
+	dst->heading_present = true;
+	dst->heading = sys_get_le16(src);
+}
+
+static void decode_rolling_time(const uint8_t *src, struct ble_lns_loc_speed_s *dst)
+{
+	dst->rolling_time_present = true;
+	dst->rolling_time = src[0];
+}
+
+static void decode_utc_time(const uint8_t *src, struct ble_lns_loc_speed_s *dst)
+{
+	dst->utc_time_time_present = true;
+	dst->utc_time.year = sys_get_le16(&src[0]);
+	dst->utc_time.month = src[2];
+	dst->utc_time.day = src[3];
+	dst->utc_time.hours = src[4];
+	dst->utc_time.minutes = src[5];
+	dst->utc_time.seconds = src[6];
+}
+
+static const struct lns_field lns_fields[] = {
+	{ BT_LNS_FLAG_INSTANT_SPEED,  2, decode_instant_speed },
+	{ BT_LNS_FLAG_TOTAL_DISTANCE, 3, decode_total_distance },
+	{ BT_LNS_FLAG_LOCATION,       8, decode_location },
+	{ BT_LNS_FLAG_ELEVATION,      3, decode_elevation },
+	{ BT_LNS_FLAG_HEADING,        2, decode_heading },
+	{ BT_LNS_FLAG_ROLLING_TIME,   1, decode_rolling_time },
+	{ BT_LNS_FLAG_UTC_TIME,       7, decode_utc_time },
+};
+
+int bt_lns_parse_location_and_speed(const uint8_t *data, uint16_t length,
+				    struct ble_lns_loc_speed_s *lns_data)
+{
+	uint16_t flags;
+	size_t expected = sizeof(flags);
+
+	if (!data || length < sizeof(flags)) {
+		return -EINVAL;
+	}
+
+	flags = sys_get_le16(data);
+
+	/* Check the whole value first so a short one leaves lns_data alone */
+	for (size_t i = 0; i < ARRAY_SIZE(lns_fields); i++) {
+		if (flags & lns_fields[i].flag) {
+			expected += lns_fields[i].size;
+		}
+	}
+	if (length < expected) {
+		return -EINVAL;
+	}
+
+	memset(lns_data, 0, sizeof(*lns_data));
+	lns_data->position_status = (flags & BT_LNS_FLAG_POSITION_STATUS_MSK) >>
+				    BT_LNS_FLAG_POSITION_STATUS_POS;
+	lns_data->data_format = (flags & BT_LNS_FLAG_DATA_FORMAT_3D) ? 1 : 0;
+	lns_data->elevation_source = (flags & BT_LNS_FLAG_ELEVATION_SRC_MSK) >>
+				     BT_LNS_FLAG_ELEVATION_SRC_POS;
+	lns_data->heading_source = (flags & BT_LNS_FLAG_HEADING_SRC_COG) ? 1 : 0;
+
+	data += sizeof(flags);
+	for (size_t i = 0; i < ARRAY_SIZE(lns_fields); i++) {
+		if (flags & lns_fields[i].flag) {
+			lns_fields[i].decode(data, lns_data);
+			data += lns_fields[i].size;
+		}
+	}
+
+	return 0;
+}
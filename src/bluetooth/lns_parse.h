@@ -0,0 +1,78 @@
+#ifndef __LNS_PARSE_H
+#define __LNS_PARSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/sys/util.h>
+
+/** Location and Speed characteristic flags. */
+#define BT_LNS_FLAG_INSTANT_SPEED       BIT(0)
+#define BT_LNS_FLAG_TOTAL_DISTANCE      BIT(1)
+#define BT_LNS_FLAG_LOCATION            BIT(2)
+#define BT_LNS_FLAG_ELEVATION           BIT(3)
+#define BT_LNS_FLAG_HEADING             BIT(4)
+#define BT_LNS_FLAG_ROLLING_TIME        BIT(5)
+#define BT_LNS_FLAG_UTC_TIME            BIT(6)
+#define BT_LNS_FLAG_POSITION_STATUS_POS 7
+#define BT_LNS_FLAG_POSITION_STATUS_MSK (0x3 << BT_LNS_FLAG_POSITION_STATUS_POS)
+#define BT_LNS_FLAG_DATA_FORMAT_3D      BIT(9)
+#define BT_LNS_FLAG_ELEVATION_SRC_POS   10
+#define BT_LNS_FLAG_ELEVATION_SRC_MSK   (0x3 << BT_LNS_FLAG_ELEVATION_SRC_POS)
+#define BT_LNS_FLAG_HEADING_SRC_COG     BIT(12)
+
+/** Largest Location and Speed value, flags and every optional field. */
+#define BT_LNS_LOC_SPEED_MAX_LEN 28
+
+/** Date Time characteristic format, as carried in the UTC Time field. */
+struct ble_date_time_s
+{
+    uint16_t year;                      /**< Year (1582-9999, 0 if unknown). */
+    uint8_t  month;                     /**< Month (1-12, 0 if unknown). */
+    uint8_t  day;                       /**< Day (1-31, 0 if unknown). */
+    uint8_t  hours;                     /**< Hours (0-23). */
+    uint8_t  minutes;                   /**< Minutes (0-59). */
+    uint8_t  seconds;                   /**< Seconds (0-59). */
+};
+
+struct ble_lns_loc_speed_s
+{
+    bool                            instant_speed_present;                     /**< Instantaneous Speed present (0=not present, 1=present). */
+    bool                            total_distance_present;                    /**< Total Distance present (0=not present, 1=present). */
+    bool                            location_present;                          /**< Location present (0=not present, 1=present). */
+    bool                            elevation_present;                         /**< Elevation present (0=not present, 1=present). */
+    bool                            heading_present;                           /**< Heading present (0=not present, 1=present). */
+    bool                            rolling_time_present;                      /**< Rolling Time present (0=not present, 1=present). */
+    bool                            utc_time_time_present;                     /**< UTC Time present (0=not present, 1=present). */
+    uint8_t                         position_status;                           /**< Status of current position (0=no position, 1=ok, 2=estimated, 3=last known). */
+    uint8_t                         data_format;                               /**< Format of data (0=2D, 1=3D). */
+    uint8_t                         elevation_source;                          /**< Source of the elevation measurement (0=GPS, 1=barometric, 2=database, 3=other). */
+    uint8_t                         heading_source;                            /**< Source of the heading measurement (0=movement, 1=magnetic compass). */
+    uint16_t                        instant_speed;                             /**< Instantaneous Speed (1/10 meter per sec). */
+    uint32_t                        total_distance;                            /**< Total Distance (1/10 meters), size=24 bits. */
+    int32_t                         latitude;                                  /**< Latitude (10e-7 degrees). */
+    int32_t                         longitude;                                 /**< Longitude (10e-7 degrees). */
+    int32_t                         elevation;                                 /**< Elevation (1/100 meters), size=24 bits. */
+    uint16_t                        heading;                                   /**< Heading (1/100 degrees). */
+    uint8_t                         rolling_time;                              /**< Rolling Time (seconds). */
+    struct ble_date_time_s          utc_time;                                  /**< UTC Time. */
+};
+
+/**
+ * @brief Parse a Location and Speed characteristic value.
+ *
+ * Every field announced by the flags is decoded, fields that are not
+ * present are cleared. The length is checked against the flags before
+ * anything is written, so @p lns_data is left untouched on error.
+ *
+ * @param data     Characteristic value.
+ * @param length   Size of the value.
+ * @param lns_data Decoded value.
+ *
+ * @retval 0 If the value was decoded.
+ * @retval -EINVAL If the value is shorter than its flags require.
+ */
+int bt_lns_parse_location_and_speed(const uint8_t *data, uint16_t length,
+				    struct ble_lns_loc_speed_s *lns_data);
+
+#endif /* __LNS_PARSE_H */
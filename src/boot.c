@@ -0,0 +1,68 @@
+#include "boot.h"
+
+// Includes
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+// Definitions
+
+LOG_MODULE_REGISTER(boot, CONFIG_OT_COMMAND_LINE_INTERFACE_LOG_LEVEL);
+
+// Globals
+
+static const char *const bootEventNames[BOOT_EVENT_COUNT] = {
+    [BOOT_SHELL_ATTACHED] = "shell attached",
+    [BOOT_BLUETOOTH_READY] = "bluetooth ready",
+    [BOOT_THREAD_ATTACHED] = "thread attached",
+    [BOOT_GATEWAY] = "gateway connected",
+    [BOOT_FIRST_PUBACK] = "first puback",
+};
+
+// Zero until the event happened
+static atomic_t _bootMs[BOOT_EVENT_COUNT];
+
+// Functions
+
+// Only the first occurrence counts, later calls are cheap no-ops
+void bootMark(enum bootEvent event)
+{
+    uint32_t now = MAX(k_uptime_get_32(), 1);
+
+    if (atomic_cas(&_bootMs[event], 0, now))
+    {
+        LOG_INF("Boot to %s: %u ms", bootEventNames[event], now);
+    }
+}
+
+uint32_t bootGet(enum bootEvent event)
+{
+    return atomic_get(&_bootMs[event]);
+}
+
+#if defined(CONFIG_SHELL)
+static int bootCmdShow(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < BOOT_EVENT_COUNT; i++)
+    {
+        uint32_t ms = bootGet(i);
+
+        if (ms)
+        {
+            shell_print(sh, "%-18s %u ms", bootEventNames[i], ms);
+        }
+        else
+        {
+            shell_print(sh, "%-18s -", bootEventNames[i]);
+        }
+    }
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(boot, NULL, "Time from boot to each startup milestone", bootCmdShow);
+#endif
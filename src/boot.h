@@ -0,0 +1,26 @@
+#ifndef BOOT_H_
+#define BOOT_H_
+
+// Includes
+
+#include <stdint.h>
+
+// Definitions
+
+// Startup milestones, each is recorded once as uptime in ms
+enum bootEvent
+{
+    BOOT_SHELL_ATTACHED,    // Host raised DTR on the CLI port
+    BOOT_BLUETOOTH_READY,
+    BOOT_THREAD_ATTACHED,   // First child, router or leader role
+    BOOT_GATEWAY,           // First CONNACK
+    BOOT_FIRST_PUBACK,
+    BOOT_EVENT_COUNT,
+};
+
+// Prototypes
+
+void bootMark(enum bootEvent event);
+uint32_t bootGet(enum bootEvent event);
+
+#endif
@@ -0,0 +1,220 @@
+#include "coex.h"
+
+// Includes
+
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include "app_bluetooth.h"
+#include "mqttsn.h"
+
+// Definitions
+
+LOG_MODULE_REGISTER(coex, CONFIG_APP_COEX_LOG_LEVEL);
+
+// Every COEX_PERIOD_MS frame opens a BLE window for the scanner, then a
+// Thread window with the scanner stopped. LNS connections keep their
+// events, their estimated radio time is taken from the BLE share first.
+// Thread is never disabled, 802.15.4 simply gets the radio whenever the
+// Bluetooth controller does not claim it.
+enum coexWindow
+{
+    COEX_WINDOW_BLE,
+    COEX_WINDOW_THREAD,
+};
+
+// Protototypes
+
+static void coexFrameHandler(struct k_work *work);
+static void coexRequestHandler(struct k_work *work);
+static void coexReleaseHandler(struct k_work *work);
+
+// Globals
+
+// All state is only touched from the system work queue
+static K_WORK_DELAYABLE_DEFINE(coexFrameWork, coexFrameHandler);
+static K_WORK_DEFINE(coexRequestWork, coexRequestHandler);
+static K_WORK_DEFINE(coexReleaseWork, coexReleaseHandler);
+static enum coexWindow _window;
+static int64_t _windowStart;
+static uint32_t _bleWindowMs;
+static bool _held;
+static uint64_t _connRadioUs;
+static struct coexStats _stats;
+
+// Functions
+
+// Charge the time since the last switch, connections run in both windows
+static void coexAccount(int64_t now)
+{
+    struct appbluetoothStats bt;
+    uint32_t elapsed = (uint32_t)(now - _windowStart);
+
+    appbluetoothGetStats(&bt);
+    _connRadioUs += (uint64_t)bt.radioUs * elapsed / MSEC_PER_SEC;
+    _stats.bleConnMs = (uint32_t)(_connRadioUs / USEC_PER_MSEC);
+
+    if (_window == COEX_WINDOW_BLE)
+    {
+        _stats.bleScanMs += elapsed;
+    }
+    else
+    {
+        _stats.threadMs += elapsed;
+    }
+
+    _windowStart = now;
+}
+
+static void coexOpen(enum coexWindow window)
+{
+    coexAccount(k_uptime_get());
+
+    if (window == _window)
+    {
+        return;
+    }
+
+    _window = window;
+    appbluetoothScanPause(window == COEX_WINDOW_THREAD);
+    if (window == COEX_WINDOW_BLE)
+    {
+        _stats.bleWindows++;
+    }
+}
+
+// Scanner share of the next frame, ends a guard time before the next publication is due
+static uint32_t coexBleWindowMs(void)
+{
+    struct appbluetoothStats bt;
+    appbluetoothGetStats(&bt);
+
+    uint32_t shareMs = COEX_PERIOD_MS * COEX_BLE_PERCENT / 100;
+    uint32_t connMs = (uint64_t)bt.radioUs * COEX_PERIOD_MS / USEC_PER_SEC;
+    uint32_t windowMs = shareMs > connMs ? shareMs - connMs : 0;
+
+    uint32_t dueMs = mqttsnNextDueMs();
+    if (windowMs >= COEX_WINDOW_MIN_MS && dueMs < windowMs + COEX_GUARD_MS)
+    {
+        windowMs = dueMs > COEX_GUARD_MS ? dueMs - COEX_GUARD_MS : 0;
+        if (windowMs < COEX_WINDOW_MIN_MS)
+        {
+            _stats.bleSkipped++;
+        }
+    }
+
+    return windowMs < COEX_WINDOW_MIN_MS ? 0 : windowMs;
+}
+
+static void coexFrameHandler(struct k_work *work)
+{
+    if (_held)
+    {
+        // Publications still in flight, BLE gets its window back anyway
+        _held = false;
+        _stats.deadlinesMissed++;
+        LOG_WRN("Publication not finished within %u ms", COEX_HOLD_MAX_MS);
+    }
+
+    if (_window == COEX_WINDOW_BLE)
+    {
+        coexOpen(COEX_WINDOW_THREAD);
+        k_work_schedule(&coexFrameWork, K_MSEC(COEX_PERIOD_MS - _bleWindowMs));
+        return;
+    }
+
+    _bleWindowMs = coexBleWindowMs();
+    if (_bleWindowMs == 0)
+    {
+        // Stay on Thread, the publication due in between ends up here again
+        k_work_schedule(&coexFrameWork, K_MSEC(COEX_PERIOD_MS));
+        return;
+    }
+
+    coexOpen(COEX_WINDOW_BLE);
+    k_work_schedule(&coexFrameWork, K_MSEC(_bleWindowMs));
+}
+
+// A publication is due, Thread keeps the radio until it is done
+static void coexRequestHandler(struct k_work *work)
+{
+    coexOpen(COEX_WINDOW_THREAD);
+
+    if (!_held)
+    {
+        _held = true;
+        _stats.threadHolds++;
+    }
+    k_work_reschedule(&coexFrameWork, K_MSEC(COEX_HOLD_MAX_MS));
+}
+
+static void coexReleaseHandler(struct k_work *work)
+{
+    if (!_held)
+    {
+        return;
+    }
+
+    _held = false;
+    _stats.deadlinesMet++;
+    k_work_reschedule(&coexFrameWork, K_NO_WAIT);
+}
+
+// Called from the stream timers, may run in interrupt context
+void coexThreadRequest(void)
+{
+    k_work_submit(&coexRequestWork);
+}
+
+void coexThreadRelease(void)
+{
+    k_work_submit(&coexReleaseWork);
+}
+
+void coexGetStats(struct coexStats *stats)
+{
+    memcpy(stats, &_stats, sizeof(*stats));
+}
+
+// Bluetooth scans from appbluetoothInit() on, so the first frame starts with BLE
+int coexInit(void)
+{
+    LOG_INF("Radio frames of %u ms, %u%% for Bluetooth", COEX_PERIOD_MS, COEX_BLE_PERCENT);
+
+    _window = COEX_WINDOW_BLE;
+    _windowStart = k_uptime_get();
+    _bleWindowMs = COEX_PERIOD_MS * COEX_BLE_PERCENT / 100;
+    _stats.bleWindows++;
+    k_work_schedule(&coexFrameWork, K_MSEC(_bleWindowMs));
+
+    return 0;
+}
+
+#if defined(CONFIG_SHELL)
+static int coexCmdStats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct coexStats stats;
+    coexGetStats(&stats);
+
+    uint32_t total = MAX(stats.bleScanMs + stats.threadMs, 1);
+
+    shell_print(sh, "Frame            %u ms, %u%% Bluetooth", COEX_PERIOD_MS, COEX_BLE_PERCENT);
+    shell_print(sh, "BLE scan         %u ms (%u%%), %u windows, %u skipped", stats.bleScanMs,
+        (uint32_t)((uint64_t)stats.bleScanMs * 100 / total), stats.bleWindows, stats.bleSkipped);
+    shell_print(sh, "BLE connections  %u ms (%u%%, estimated)", stats.bleConnMs,
+        (uint32_t)((uint64_t)stats.bleConnMs * 100 / total));
+    shell_print(sh, "Thread           %u ms (%u%%)", stats.threadMs,
+        (uint32_t)((uint64_t)stats.threadMs * 100 / total));
+    shell_print(sh, "Publish holds    %u, %u met, %u missed", stats.threadHolds,
+        stats.deadlinesMet, stats.deadlinesMissed);
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(coex, NULL, "Radio time of Bluetooth and Thread", coexCmdStats);
+#endif
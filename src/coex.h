@@ -0,0 +1,47 @@
+#ifndef COEX_H_
+#define COEX_H_
+
+// Includes
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+// Definitions
+
+#define COEX_PERIOD_MS CONFIG_APP_COEX_PERIOD_MS
+#define COEX_BLE_PERCENT CONFIG_APP_COEX_BLE_PERCENT
+#define COEX_GUARD_MS CONFIG_APP_COEX_GUARD_MS
+#define COEX_HOLD_MAX_MS CONFIG_APP_COEX_HOLD_MAX_MS
+#define COEX_WINDOW_MIN_MS 10   // Shorter BLE windows are not worth restarting the scanner
+
+struct coexStats
+{
+    uint32_t bleScanMs;     // Time the scanner was allowed to run
+    uint32_t bleConnMs;     // Estimated radio time of the LNS connections
+    uint32_t threadMs;      // Time reserved for 802.15.4
+    uint32_t bleWindows;
+    uint32_t threadHolds;   // Thread windows held open for a publication
+    uint32_t deadlinesMet;  // Publications finished while held
+    uint32_t deadlinesMissed;   // Hold expired with publications still in flight
+    uint32_t bleSkipped;    // BLE windows dropped because a publication was due
+};
+
+// Prototypes
+
+#if defined(CONFIG_APP_COEX)
+
+int coexInit(void);
+void coexThreadRequest(void);
+void coexThreadRelease(void);
+void coexGetStats(struct coexStats *stats);
+
+#else
+
+static inline int coexInit(void) { return 0; }
+static inline void coexThreadRequest(void) {}
+static inline void coexThreadRelease(void) {}
+
+#endif
+
+#endif
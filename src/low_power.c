@@ -5,18 +5,25 @@
  */
 
 #include <openthread/thread.h>
-#include <zephyr/net/openthread.h>
 #include <zephyr/device.h>
 #include <zephyr/pm/device.h>
 #include <ram_pwrdn.h>
 
 #include "low_power.h"
+#include "mqttsn.h"
+#include "state.h"
 
-static void on_thread_state_changed(otChangedFlags flags, struct openthread_context *ot_context,
-				    void *user_data)
+static void on_thread_state_changed(otInstance *instance, otChangedFlags flags)
 {
 	if (flags & OT_CHANGED_THREAD_ROLE) {
-		if (otThreadGetDeviceRole(ot_context->instance) == OT_DEVICE_ROLE_CHILD) {
+		otDeviceRole role = otThreadGetDeviceRole(instance);
+
+		/* MQTT-SN sleeps between publications only while we are a sleepy child */
+		if (IS_ENABLED(CONFIG_MQTT_SNCLIENT_SLEEP)) {
+			mqttsnSetSleepEnabled(role == OT_DEVICE_ROLE_CHILD);
+		}
+
+		if (role == OT_DEVICE_ROLE_CHILD) {
 			const struct device *cons = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
 
 			if (!device_is_ready(cons)) {
@@ -29,11 +36,12 @@ static void on_thread_state_changed(otChangedFlags flags, struct openthread_cont
 	}
 }
 
-static struct openthread_state_changed_cb ot_state_chaged_cb = {
-	.state_changed_cb = on_thread_state_changed
+static struct stateSubscriber ot_state_subscriber = {
+	.mask = OT_CHANGED_THREAD_ROLE,
+	.handler = on_thread_state_changed
 };
 
 void low_power_enable(void)
 {
-	openthread_state_changed_cb_register(openthread_get_default_context(), &ot_state_chaged_cb);
+	stateSubscribe(&ot_state_subscriber);
 }
@@ -7,22 +7,33 @@
 // Includes
 
 #include <stdio.h>
+#include <string.h>
 
 #include <zephyr/drivers/uart.h>
+#include <zephyr/settings/settings.h>
 #include <zephyr/usb/usb_device.h>
 
 #include <openthread/platform/logging.h>
+#include "openthread/dataset.h"
 #include "openthread/instance.h"
 #include "openthread/thread.h"
 
 #include "utils.h"
 #include "mqttsn.h"
 #include "app_bluetooth.h"
+#include "perf.h"
+#include "coex.h"
+#include "boot.h"
+#include "state.h"
 
 #if defined(CONFIG_CLI_SAMPLE_LOW_POWER)
 #include "low_power.h"
 #endif
 
+#if defined(CONFIG_OPENTHREAD_MANUAL_START)
+#include "dataset_config.h"
+#endif
+
 // Definitions
 
 LOG_MODULE_REGISTER(cli_main, CONFIG_OT_COMMAND_LINE_INTERFACE_LOG_LEVEL);
@@ -37,153 +48,155 @@ LOG_MODULE_REGISTER(cli_main, CONFIG_OT_COMMAND_LINE_INTERFACE_LOG_LEVEL);
 	"documentation at:\n\r" \
 	"https://github.com/openthread/openthread/blob/master/src/cli/README.md\n\r"
 
+#define DTR_POLL_INTERVAL_MS 100
+
+#if defined(CONFIG_OPENTHREAD_MANUAL_START)
+BUILD_ASSERT(sizeof(CONFIG_OPENTHREAD_NETWORK_NAME) <= sizeof(otNetworkName),
+    "CONFIG_OPENTHREAD_NETWORK_NAME is longer than 16 characters");
+
+// Network credentials, the byte arrays are generated from the Kconfig strings at build time
+static const otOperationalDataset datasetConfig = {
+    .mNetworkKey = { .m8 = DATASET_NETWORK_KEY },
+    .mNetworkName = { .m8 = CONFIG_OPENTHREAD_NETWORK_NAME },
+    .mExtendedPanId = { .m8 = DATASET_EXTENDED_PANID },
+    .mPanId = CONFIG_OPENTHREAD_WORKING_PANID,
+    .mChannel = CONFIG_OPENTHREAD_CHANNEL,
+    .mComponents = {
+        .mIsNetworkKeyPresent = true,
+        .mIsNetworkNamePresent = true,
+        .mIsExtendedPanIdPresent = true,
+        .mIsPanIdPresent = true,
+        .mIsChannelPresent = CONFIG_OPENTHREAD_CHANNEL > 0,
+    },
+};
+#endif
+
 // Functions
 
+#if DT_NODE_HAS_COMPAT(DT_CHOSEN(zephyr_shell_uart), zephyr_cdc_acm_uart)
+static void dtrWorkHandler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(dtrWork, dtrWorkHandler);
+static K_SEM_DEFINE(dtrSem, 0, 1);
+
+// CDC ACM has no line state callback, DTR is sampled in the background
+// until the host opens the port, startup does not wait for it
+static void dtrWorkHandler(struct k_work *work)
+{
+	const struct device *dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_shell_uart));
+	uint32_t dtr = 0U;
+	int ret;
+
+	/* Data Terminal Ready - check if host is ready to communicate */
+	ret = uart_line_ctrl_get(dev, UART_LINE_CTRL_DTR, &dtr);
+	if (ret || !dtr) {
+		k_work_schedule(&dtrWork, K_MSEC(DTR_POLL_INTERVAL_MS));
+		return;
+	}
+
+	/* Data Carrier Detect Modem - mark connection as established */
+	(void)uart_line_ctrl_set(dev, UART_LINE_CTRL_DCD, 1);
+	/* Data Set Ready - the NCP SoC is ready to communicate */
+	(void)uart_line_ctrl_set(dev, UART_LINE_CTRL_DSR, 1);
+
+	bootMark(BOOT_SHELL_ATTACHED);
+	k_sem_give(&dtrSem);
+}
+#endif
+
 // OpenThread Support Functions
 
-static void otStateChanged(otChangedFlags aFlags, void *aContext)
+#if defined(CONFIG_OPENTHREAD_MANUAL_START)
+static bool datasetMatches(const otOperationalDataset *dataset)
+{
+    const otOperationalDatasetComponents *have = &dataset->mComponents;
+
+    return have->mIsNetworkKeyPresent &&
+        memcmp(&dataset->mNetworkKey, &datasetConfig.mNetworkKey, sizeof(otNetworkKey)) == 0 &&
+        have->mIsNetworkNamePresent &&
+        strcmp(dataset->mNetworkName.m8, datasetConfig.mNetworkName.m8) == 0 &&
+        have->mIsExtendedPanIdPresent &&
+        memcmp(&dataset->mExtendedPanId, &datasetConfig.mExtendedPanId, sizeof(otExtendedPanId)) == 0 &&
+        have->mIsPanIdPresent && dataset->mPanId == datasetConfig.mPanId &&
+        (!datasetConfig.mComponents.mIsChannelPresent ||
+            (have->mIsChannelPresent && dataset->mChannel == datasetConfig.mChannel));
+}
+
+// Apply the configured credentials as one Active Dataset write instead of a setter per
+// parameter, each of which stored the dataset and raised its own state change. The stored
+// dataset is kept as is when it already matches, so a normal boot does not touch flash.
+static otError datasetProvision(otInstance *instance)
 {
-    otInstance *instance = (otInstance *)aContext;
+    otOperationalDataset dataset;
+    otError error;
 
-    // when thread role changed
-    if (aFlags & OT_CHANGED_THREAD_ROLE)
+    if (otDatasetGetActive(instance, &dataset) == OT_ERROR_NONE && datasetMatches(&dataset))
     {
-        otDeviceRole role = (int)otThreadGetDeviceRole(instance);
-		switch(role)
-		{
-		    case 0: // OT_DEVICE_ROLE_DISABLED:
-    			LOG_INF("Role changed to disabled");
-				break;
-    		case 1: // OT_DEVICE_ROLE_DETACHED:
-    			LOG_INF("Role changed to detached");
-				break;
-    		case 2: // OT_DEVICE_ROLE_CHILD:
-    			LOG_INF("Role changed to child");
-				break;
-    		case 3: // OT_DEVICE_ROLE_ROUTER:
-    			LOG_INF("Role changed to router");
-				break;
-    		case 4: //OT_DEVICE_ROLE_LEADER:
-    			LOG_INF("Role changed to leader");
-				break;
-		}
-
-        // If role changed to any of active roles then send SEARCHGW message
-        if (role == OT_DEVICE_ROLE_CHILD || role == OT_DEVICE_ROLE_ROUTER || role == OT_DEVICE_ROLE_LEADER)
-        {
-            mqttsnSearchGateway(instance);
-        }
+        LOG_INF("Active dataset for %s up to date", CONFIG_OPENTHREAD_NETWORK_NAME);
+        return OT_ERROR_NONE;
+    }
+
+    // Only the credentials and no Active Timestamp. A node attaching to an existing
+    // partition takes the leader's complete dataset, and a node forming one generates the
+    // mesh local prefix, PSKc and security policy. Starting from otDatasetCreateNewNetwork()
+    // or a stored dataset instead would give every node its own random components under
+    // the same timestamp, and none of them would adopt the leader's.
+    memset(&dataset, 0, sizeof(dataset));
+    dataset.mNetworkKey = datasetConfig.mNetworkKey;
+    dataset.mNetworkName = datasetConfig.mNetworkName;
+    dataset.mExtendedPanId = datasetConfig.mExtendedPanId;
+    dataset.mPanId = datasetConfig.mPanId;
+    dataset.mComponents.mIsNetworkKeyPresent = true;
+    dataset.mComponents.mIsNetworkNamePresent = true;
+    dataset.mComponents.mIsExtendedPanIdPresent = true;
+    dataset.mComponents.mIsPanIdPresent = true;
+    if (datasetConfig.mComponents.mIsChannelPresent)
+    {
+        dataset.mChannel = datasetConfig.mChannel;
+        dataset.mComponents.mIsChannelPresent = true;
+    }
+
+    LOG_INF("Setting active dataset for %s, PANID 0x%04X, channel %d",
+        CONFIG_OPENTHREAD_NETWORK_NAME, datasetConfig.mPanId, CONFIG_OPENTHREAD_CHANNEL);
+    error = otDatasetSetActive(instance, &dataset);
+    if (error != OT_ERROR_NONE)
+    {
+        LOG_ERR("Failed to set the active dataset (err %d)", error);
+    }
+
+    return error;
+}
+#endif
+
+static void roleChanged(otInstance *instance, otChangedFlags flags)
+{
+    static const char *const roleNames[] = {
+        [OT_DEVICE_ROLE_DISABLED] = "disabled",
+        [OT_DEVICE_ROLE_DETACHED] = "detached",
+        [OT_DEVICE_ROLE_CHILD] = "child",
+        [OT_DEVICE_ROLE_ROUTER] = "router",
+        [OT_DEVICE_ROLE_LEADER] = "leader",
+    };
+    otDeviceRole role = otThreadGetDeviceRole(instance);
+
+    LOG_INF("Role changed to %s", role < ARRAY_SIZE(roleNames) ? roleNames[role] : "unknown");
+    if (role >= OT_DEVICE_ROLE_CHILD)
+    {
+        bootMark(BOOT_THREAD_ATTACHED);
     }
-	else
-	{
-		LOG_INF("State change: Flags 0x%08X", aFlags);
-		switch(aFlags)
-		{
-			case OT_CHANGED_IP6_ADDRESS_ADDED:
-				LOG_INF("IPv6 address was added");
-				break;
-			case OT_CHANGED_IP6_ADDRESS_REMOVED:
-				LOG_INF("IPv6 address was removed");
-				break;
-			case OT_CHANGED_THREAD_ROLE:
-				LOG_INF("Role (disabled, detached, child, router, leader) changed");
-				break;
-			case OT_CHANGED_THREAD_LL_ADDR:
-				LOG_INF("The link-local address changed");
-				break;
-			case OT_CHANGED_THREAD_ML_ADDR:
-				LOG_INF("The mesh-local address changed");
-				break;
-			case OT_CHANGED_THREAD_RLOC_ADDED:
-				LOG_INF("RLOC was added");
-				break;
-			case OT_CHANGED_THREAD_RLOC_REMOVED:
-				LOG_INF("RLOC was removed");
-				break;
-			case OT_CHANGED_THREAD_PARTITION_ID:
-				LOG_INF("Partition ID changed");
-				break;
-			case OT_CHANGED_THREAD_KEY_SEQUENCE_COUNTER:
-				LOG_INF("Thread Key Sequence changed");
-				break;
-			case OT_CHANGED_THREAD_NETDATA:
-				LOG_INF("Thread Network Data changed");
-				break;
-			case OT_CHANGED_THREAD_CHILD_ADDED:
-				LOG_INF("Child was added");
-				break;
-			case OT_CHANGED_THREAD_CHILD_REMOVED:
-				LOG_INF("Child was removed");
-				break;
-			case OT_CHANGED_IP6_MULTICAST_SUBSCRIBED:
-				LOG_INF("Subscribed to a IPv6 multicast address");
-				break;
-			case OT_CHANGED_IP6_MULTICAST_UNSUBSCRIBED:
-				LOG_INF("Unsubscribed from a IPv6 multicast address");
-				break;
-			case OT_CHANGED_THREAD_CHANNEL:
-				LOG_INF("Thread network channel changed");
-				break;
-			case OT_CHANGED_THREAD_PANID:
-				LOG_INF("Thread network PAN Id changed");
-				break;
-			case OT_CHANGED_THREAD_NETWORK_NAME:
-				LOG_INF("Thread network name changed");
-				break;
-			case OT_CHANGED_THREAD_EXT_PANID:
-				LOG_INF("Thread network extended PAN ID changed");
-				break;
-			case OT_CHANGED_NETWORK_KEY:
-				LOG_INF("Network key changed");
-				break;
-			case OT_CHANGED_PSKC:
-				LOG_INF("PSKc changed");
-				break;
-			case OT_CHANGED_SECURITY_POLICY:
-				LOG_INF("Security Policy changed");
-				break;
-			case OT_CHANGED_CHANNEL_MANAGER_NEW_CHANNEL:
-				LOG_INF("Channel Manager new pending Thread channel changed");
-				break;
-			case OT_CHANGED_SUPPORTED_CHANNEL_MASK:
-				LOG_INF("Supported channel mask changed");
-				break;
-			case OT_CHANGED_COMMISSIONER_STATE:
-				LOG_INF("Commissioner state changed");
-				break;
-			case OT_CHANGED_THREAD_NETIF_STATE:
-				LOG_INF("Thread network interface state changed");
-				break;
-			case OT_CHANGED_THREAD_BACKBONE_ROUTER_STATE:
-				LOG_INF("Backbone Router state changed");
-				break;
-			case OT_CHANGED_THREAD_BACKBONE_ROUTER_LOCAL:
-				LOG_INF("Local Backbone Router configuration changed");
-				break;
-			case OT_CHANGED_JOINER_STATE:
-				LOG_INF("Joiner state changed");
-				break;
-			case OT_CHANGED_ACTIVE_DATASET:
-				LOG_INF("Active Operational Dataset changed");
-				break;
-			case OT_CHANGED_PENDING_DATASET:
-				LOG_INF("Pending Operational Dataset changed");
-				break;
-			case OT_CHANGED_NAT64_TRANSLATOR_STATE:
-				LOG_INF("The state of NAT64 translator changed");
-				break;
-		}
-	}
 }
 
+static struct stateSubscriber roleSubscriber = {
+    .mask = OT_CHANGED_THREAD_ROLE,
+    .handler = roleChanged,
+};
+
 // Main Function
 
 int main(int aArgc, char *aArgv[])
 {
 #if DT_NODE_HAS_COMPAT(DT_CHOSEN(zephyr_shell_uart), zephyr_cdc_acm_uart)
 	int ret;
-	const struct device *dev;
-	uint32_t dtr = 0U;
 
 	ret = usb_enable(NULL);
 	if (ret != 0) {
@@ -191,31 +204,12 @@ int main(int aArgc, char *aArgv[])
 		return 0;
 	}
 
-	dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_shell_uart));
-	if (dev == NULL) {
-		LOG_ERR("Failed to find specific UART device");
-		return 0;
-	}
+	k_work_schedule(&dtrWork, K_NO_WAIT);
 
 #if defined(CONFIG_WAIT_FOR_CLI_CONNECTION)
 	LOG_INF("Waiting for host to be ready to communicate");
-
-	/* Data Terminal Ready - check if host is ready to communicate */
-	while (!dtr) {
-		ret = uart_line_ctrl_get(dev, UART_LINE_CTRL_DTR, &dtr);
-		if (ret) {
-			LOG_ERR("Failed to get Data Terminal Ready line state: %d",
-				ret);
-			continue;
-		}
-		k_msleep(100);
-	}
+	k_sem_take(&dtrSem, K_FOREVER);
 #endif
-
-	/* Data Carrier Detect Modem - mark connection as established */
-	(void)uart_line_ctrl_set(dev, UART_LINE_CTRL_DCD, 1);
-	/* Data Set Ready - the NCP SoC is ready to communicate */
-	(void)uart_line_ctrl_set(dev, UART_LINE_CTRL_DSR, 1);
 #endif
 
 	LOG_INF(WELLCOME_TEXT);
@@ -224,6 +218,16 @@ int main(int aArgc, char *aArgv[])
 	low_power_enable();
 #endif
 
+	// Once up front, Bluetooth and MQTT-SN load their subtrees concurrently
+#if defined(CONFIG_SETTINGS)
+	if (settings_subsys_init()) {
+		LOG_ERR("Failed to initialize settings");
+	}
+#endif
+
+	// Start Bluetooth, the controller comes up in the background
+    appbluetoothInit();
+
 	// New code
 	otInstance *instance;
     otError error = OT_ERROR_NONE;
@@ -231,34 +235,12 @@ int main(int aArgc, char *aArgv[])
     instance = openthread_get_default_instance();
 
 #if defined(CONFIG_OPENTHREAD_MANUAL_START)
-    otExtendedPanId extendedPanid;
-    otNetworkKey masterKey;
-
-	// Set default network settings
-    // Set network name
-    LOG_INF("Setting Network Name to %s", CONFIG_OPENTHREAD_NETWORK_NAME);
-    error = otThreadSetNetworkName(instance, CONFIG_OPENTHREAD_NETWORK_NAME);
-    // Set PANID
-    LOG_INF("Setting PANID to 0x%04X", (uint16_t)CONFIG_OPENTHREAD_WORKING_PANID);
-    error = otLinkSetPanId(instance, (const otPanId)CONFIG_OPENTHREAD_WORKING_PANID);
-    // Set extended PANID
-    LOG_INF("Setting extended PANID to %s", CONFIG_OPENTHREAD_XPANID);
-	int val = datahex(CONFIG_OPENTHREAD_XPANID, &extendedPanid.m8[0], 8);
-	error = otThreadSetExtendedPanId(instance, (const otExtendedPanId *)&extendedPanid);
-    // Set channel if configured
-	if(CONFIG_OPENTHREAD_CHANNEL > 0)
-	{
-	    LOG_INF("Setting Channel to %d", CONFIG_OPENTHREAD_CHANNEL);
-    	error = otLinkSetChannel(instance, CONFIG_OPENTHREAD_CHANNEL);
-	}
-    // Set masterkey
-    LOG_INF("Setting Network Key to %s", CONFIG_OPENTHREAD_NETWORKKEY);
-	datahex(CONFIG_OPENTHREAD_NETWORKKEY, &masterKey.m8[0], 16);
-    error = otThreadSetNetworkKey(instance, (const otNetworkKey *)&masterKey);
+    error = datasetProvision(instance);
 #endif
 
-    // Register notifier callback to receive thread role changed events
-    error = otSetStateChangedCallback(instance, otStateChanged, instance);
+    // Dispatch state changes to the modules that subscribed to them
+    stateSubscribe(&roleSubscriber);
+    stateInit(instance);
 
     // Start thread network
 #ifdef OPENTHREAD_CONFIG_IP6_SLAAC_ENABLE
@@ -267,11 +249,11 @@ int main(int aArgc, char *aArgv[])
     error = otIp6SetEnabled(instance, true);
     error = otThreadSetEnabled(instance, true);
 
-	// Start Bluetooth
-    appbluetoothInit();
-
 	// Start MQTT-SN client
 	mqttsnInit();
 
+	// Share the radio between Bluetooth scanning and Thread
+	coexInit();
+
     return 0;
 }
\ No newline at end of file
@@ -2,293 +2,1953 @@
 
 // Includes
 
-#include <stdio.h>
-
 #include "openthread/mqttsn.h"
 #include "openthread/link.h"
+#include "openthread/thread.h"
+#if defined(CONFIG_OPENTHREAD_PING_SENDER)
+#include "openthread/ping_sender.h"
+#endif
+
+#include "app_bluetooth.h"
+#include "payload.h"
+#include "mqttsn_store.h"
+#include "perf.h"
+#include "coex.h"
+#include "boot.h"
+#include "state.h"
+
+#include <math.h>
 
 #include <zephyr/logging/log.h>
+#include <zephyr/init.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/settings/settings.h>
 
 // Definitions
 
+#define EUI64_STRING_LENGTH 16
+
+struct mqttsnGateway
+{
+    otIp6Address address;
+    uint8_t gatewayId;
+};
+
+#define MQTTSN_RATE_PERIOD_MS 10000
+#define MQTTSN_WINDOW_RETRY_MS 500
+
+#define METRES_PER_LAT_UNIT 0.0111319f  // 1e-7 degree of latitude
+#define RADIANS_PER_LAT_UNIT 1.7453293e-9f
+
+// Independently timed publication stream
+struct mqttsnStream
+{
+    const char *name;
+    enum mqttsnWorkItem item;
+    uint32_t periodMs;      // 0 disables the stream
+    void (*handler)(otInstance *instance);
+    struct k_timer timer;
+    struct k_work work;
+};
+
+// Runtime tunable value, persisted as "mqttsn/cfg/<name>"
+struct mqttsnParam
+{
+    const char *name;
+    uint32_t *value;
+    uint32_t defaultValue;
+    uint32_t min;
+    uint32_t max;
+    struct mqttsnStream *stream;    // Restarted when the value changes
+};
+
+#define MQTTSN_CONFIG_GATEWAY "gateway"
+
+#if defined(CONFIG_MQTT_SNCLIENT_REPORT_BY_EXCEPTION)
+// Last report per location source, each Bluetooth tag plus the node without a fix
+#define MQTTSN_REPORTED_MAX (CONFIG_BT_MAX_CONN + 1)
+
+struct mqttsnReported
+{
+    struct payloadRecord record;
+    int64_t time;
+    bool valid;
+};
+#endif
+
+#if defined(CONFIG_MQTT_SNCLIENT_BATCH)
+// A batch frame carries the whole batch, all of it is stored again on failure
+#define MQTTSN_REQUEUE_MAX PAYLOAD_BATCH_MAX
+#else
+#define MQTTSN_REQUEUE_MAX 1
+#endif
+
+enum mqttsnSlotState
+{
+    MQTTSN_SLOT_FREE,
+    MQTTSN_SLOT_SENT,       // Waiting for PUBACK
+    MQTTSN_SLOT_ACKED,      // Acknowledged, the stored sample is deleted by the drain work
+    MQTTSN_SLOT_FAILED,     // Gave up, records go back to the store
+};
+
+// One unacknowledged QoS1 publication
+struct mqttsnInFlight
+{
+    uint8_t state;
+    uint8_t qos;
+    uint8_t retransmits;
+    uint16_t msgId;
+    uint16_t length;
+    int64_t sentTime;
+    uint8_t data[PAYLOAD_MAX_SIZE];
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    uint8_t recordCount;
+    struct payloadRecord records[MQTTSN_REQUEUE_MAX];  // Samples stored again if never acknowledged
+    bool stored;            // Carries the stored sample storeSeq, deleted once acknowledged
+    uint32_t storeSeq;
+#endif
+};
+
 // Protototypes
 
-void mqttsnPublishHandler(struct k_timer *dummy);
+static void mqttsnStatusStreamHandler(otInstance *instance);
+static void mqttsnLocationStreamHandler(otInstance *instance);
+static void mqttsnDiagStreamHandler(otInstance *instance);
+static void mqttsnHandlePublished(otMqttsnReturnCode aCode, void* aContext);
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+static void mqttsnDrainWorkHandler(struct k_work *work);
+#endif
+#if defined(CONFIG_MQTT_SNCLIENT_BATCH)
+static void mqttsnBatchWorkHandler(struct k_work *work);
+#endif
+#if defined(CONFIG_MQTT_SNCLIENT_SLEEP)
+static void mqttsnSleepWorkHandler(struct k_work *work);
+#endif
+static void mqttsnRoleWorkHandler(struct k_work *work);
 
 // Globals
 
+static K_THREAD_STACK_DEFINE(mqttsnWorkQueueStack, CONFIG_MQTT_SNCLIENT_WORKQ_STACK_SIZE);
+static struct k_work_q mqttsnWorkQueue;
+static uint32_t _workDue[MQTTSN_WORK_COUNT];
 static otMqttsnTopic _aTopic;
-static K_TIMER_DEFINE(mqttsnPublishTimer, mqttsnPublishHandler, NULL);
-static uint32_t _stateCount = 0;
+static bool _topicReady;
+static bool _connecting;
+#if defined(CONFIG_OPENTHREAD_PING_SENDER)
+static bool _probing;
+#endif
+static struct mqttsnGateway _gateway;
+static struct mqttsnStats _stats;
+static atomic_t _inFlight;
+static struct mqttsnInFlight _window[CONFIG_MQTT_SNCLIENT_INFLIGHT_MAX];
+static K_MUTEX_DEFINE(_windowLock);
+static uint16_t _nextMsgId;
+static int64_t _rateStart;
+static uint32_t _rateCount;
+#if defined(CONFIG_MQTT_SNCLIENT_SLEEP)
+static K_WORK_DELAYABLE_DEFINE(mqttsnSleepWork, mqttsnSleepWorkHandler);
+static atomic_t _sleepEnabled;
+static int64_t _wakeStart;
+#endif
+static K_WORK_DELAYABLE_DEFINE(mqttsnRoleWork, mqttsnRoleWorkHandler);
+static uint32_t _searchBackoffMs = CONFIG_MQTT_SNCLIENT_SEARCH_BACKOFF_MIN_MS;
+static int64_t _searchNextTime;
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+static struct mqttsnGateway _gatewayCache;
+static bool _gatewayCacheValid;
+static bool _gatewayCacheFailed;
+static bool _connectFromCache;
+#endif
+#if defined(CONFIG_MQTT_SNCLIENT_REPORT_BY_EXCEPTION)
+static struct mqttsnReported _reported[MQTTSN_REPORTED_MAX];
+#endif
+static struct bt_lns_sample _fix;
+static bool _fixValid;
+static char _clientId[sizeof(CLIENT_PREFIX) + 1 + EUI64_STRING_LENGTH];
+#if defined(CONFIG_MQTT_SNCLIENT_TOPIC_NAME)
+static char _topicName[sizeof(TOPIC_PREFIX) + 1 + EUI64_STRING_LENGTH];
+#elif defined(CONFIG_MQTT_SNCLIENT_TOPIC_SHORT)
+static char _shortTopicName[] = CONFIG_MQTT_SNCLIENT_TOPIC_SHORT_NAME;
+
+BUILD_ASSERT(sizeof(_shortTopicName) == 3, "Short topic names are two characters");
+#endif
+static struct mqttsnStream _streams[] = {
+    [MQTTSN_WORK_STATUS] = { "status", MQTTSN_WORK_STATUS, PUBLISH_INTERVAL_MS, mqttsnStatusStreamHandler },
+    [MQTTSN_WORK_LOCATION] = { "location", MQTTSN_WORK_LOCATION, CONFIG_MQTT_SNCLIENT_LOCATION_INTERVAL_MS, mqttsnLocationStreamHandler },
+    [MQTTSN_WORK_DIAG] = { "diag", MQTTSN_WORK_DIAG, CONFIG_MQTT_SNCLIENT_DIAG_INTERVAL_MS, mqttsnDiagStreamHandler },
+};
+static otExtAddress _extAddress;
+static bool _streamsStarted;
+static bool _connectedOnce;
+static bool _publishedOnce;
+
+// Runtime configuration, applied on the next publication, CONNECT or SEARCHGW
+static uint32_t _qos = PUBLISH_QOS;
+static uint32_t _keepAliveS = KEEPALIVE_S;
+static uint32_t _retransmissionCount = RETRANSMISSION_COUNT;
+static uint32_t _retransmissionTimeoutS = RETRANSMISSION_TIMEOUT_S;
+static uint32_t _hops = GATEWAY_MULTICAST_RADIUS;
+static uint32_t _roleStableMs = ROLE_STABLE_MS;
+static char _gatewayAddress[OT_IP6_ADDRESS_STRING_SIZE] = GATEWAY_MULTICAST_ADDRESS;
+static K_MUTEX_DEFINE(_configLock);
+static const struct mqttsnParam _params[] = {
+    { "interval_ms", &_streams[MQTTSN_WORK_STATUS].periodMs, PUBLISH_INTERVAL_MS, 0, 86400000,
+        &_streams[MQTTSN_WORK_STATUS] },
+    { "location_interval_ms", &_streams[MQTTSN_WORK_LOCATION].periodMs,
+        CONFIG_MQTT_SNCLIENT_LOCATION_INTERVAL_MS, 0, 86400000, &_streams[MQTTSN_WORK_LOCATION] },
+    { "diag_interval_ms", &_streams[MQTTSN_WORK_DIAG].periodMs, CONFIG_MQTT_SNCLIENT_DIAG_INTERVAL_MS,
+        0, 86400000, &_streams[MQTTSN_WORK_DIAG] },
+    { "qos", &_qos, PUBLISH_QOS, kQos0, kQos2, NULL },
+    { "keepalive_s", &_keepAliveS, KEEPALIVE_S, 1, 65535, NULL },
+    { "retransmissions", &_retransmissionCount, RETRANSMISSION_COUNT, 0, 255, NULL },
+    { "retransmission_timeout_s", &_retransmissionTimeoutS, RETRANSMISSION_TIMEOUT_S, 1, 3600, NULL },
+    { "hops", &_hops, GATEWAY_MULTICAST_RADIUS, 1, 255, NULL },
+    { "role_stable_ms", &_roleStableMs, ROLE_STABLE_MS, 0, 60000, NULL },
+};
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+static K_WORK_DELAYABLE_DEFINE(mqttsnDrainWork, mqttsnDrainWorkHandler);
+static bool _drainRewind;
+// Samples kept under the OpenThread API lock, written to flash once it is released
+static K_MSGQ_DEFINE(_storeQueue, sizeof(struct payloadRecord), MQTTSN_REQUEUE_MAX + 1, 4);
+#endif
+#if defined(CONFIG_MQTT_SNCLIENT_BATCH)
+static K_WORK_DELAYABLE_DEFINE(mqttsnBatchWork, mqttsnBatchWorkHandler);
+static struct payloadRecord _batch[PAYLOAD_BATCH_MAX];
+static size_t _batchCount;
+static int64_t _batchStart;
+
+BUILD_ASSERT(FRAME_PAYLOAD_SIZE > 0, "No room for a payload in a single frame");
+#endif
+
+#if defined(CONFIG_OPENTHREAD_THREAD_PRIORITY)
+BUILD_ASSERT(CONFIG_MQTT_SNCLIENT_WORKQ_PRIORITY > CONFIG_OPENTHREAD_THREAD_PRIORITY,
+    "The MQTT-SN work queue must not preempt the OpenThread thread");
+#endif
 
 // Functions
 
 LOG_MODULE_REGISTER(mqttsn, CONFIG_MQTT_SNCLIENT_LOG_LEVEL);
 
 // Support functions
-static void mqttsnHandlePublished(otMqttsnReturnCode aCode, void* aContext)
+
+static bool mqttsnCanPublish(otMqttsnClientState state)
 {
-    OT_UNUSED_VARIABLE(aCode);
-    OT_UNUSED_VARIABLE(aContext);
+    return state == kStateActive || state == kStateAwake;
+}
 
-    // Handle published
-    LOG_INF("Published");
+// Work items call into OpenThread from their own thread, the OpenThread thread
+// holds the same lock while it runs the stack and the MQTT-SN callbacks
+static void mqttsnApiLock(void)
+{
+    openthread_api_mutex_lock(openthread_get_default_context());
 }
 
-static void mqttsnHandleRegistered(otMqttsnReturnCode aCode, const otMqttsnTopic* aTopic, void* aContext)
+static void mqttsnApiUnlock(void)
 {
-    // Handle registered
-//    otInstance *instance = (otInstance *)aContext;
-    if (aCode == kCodeAccepted)
+    openthread_api_mutex_unlock(openthread_get_default_context());
+}
+
+// Run a work item on the MQTT-SN queue and remember when it is due
+static void mqttsnWorkSchedule(enum mqttsnWorkItem item, struct k_work_delayable *work, uint32_t delayMs)
+{
+    uint32_t due = (uint32_t)k_uptime_ticks() + k_ms_to_ticks_ceil32(delayMs);
+
+    // An already pending item keeps its original due time
+    if (k_work_schedule_for_queue(&mqttsnWorkQueue, work, K_MSEC(delayMs)) == 1)
     {
-        LOG_DBG("HandleRegistered - OK");
-        memcpy(&_aTopic, aTopic, sizeof(otMqttsnTopic));
+        _workDue[item] = due;
     }
-    else
+}
+
+static void mqttsnWorkSubmit(enum mqttsnWorkItem item, struct k_work *work)
+{
+    uint32_t due = (uint32_t)k_uptime_ticks();
+
+    if (k_work_submit_to_queue(&mqttsnWorkQueue, work) == 1)
     {
-        LOG_WRN("HandleRegistered - Error");
+        _workDue[item] = due;
     }
 }
 
-static void mqttsnHandleConnected(otMqttsnReturnCode aCode, void* aContext)
+// Account the time an item waited in the queue past its due time
+static void mqttsnWorkStarted(enum mqttsnWorkItem item)
 {
-    // Handle connected
-    otInstance *instance = (otInstance *)aContext;
-    if (aCode == kCodeAccepted)
+    struct mqttsnWorkStats *stats = &_stats.work[item];
+    int32_t late = (int32_t)((uint32_t)k_uptime_ticks() - _workDue[item]);
+    uint32_t delay = k_ticks_to_us_floor32(MAX(late, 0));
+
+    stats->runs++;
+    stats->delayLastUs = delay;
+    stats->delayMaxUs = MAX(stats->delayMaxUs, delay);
+    stats->delayTotalUs += delay;
+}
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+// Stored samples, including those not written yet
+static uint32_t mqttsnStorePending(void)
+{
+    return mqttsnStoreCount() + k_msgq_num_used_get(&_storeQueue);
+}
+
+static void mqttsnStoreLater(const struct payloadRecord *record)
+{
+    if (k_msgq_put(&_storeQueue, record, K_NO_WAIT) != 0)
     {
-        LOG_DBG("HandleConnected -Accepted");
+        LOG_WRN("Store queue full, sample dropped");
+    }
+}
 
-        // Get ID
-        otExtAddress extAddress;
-        otLinkGetFactoryAssignedIeeeEui64(instance, &extAddress);
+// Called without the OpenThread API lock, flash writes would stall the stack
+static void mqttsnStoreQueued(void)
+{
+    struct payloadRecord record;
 
-        char data[128];
-        sprintf(data, "%s/%02x%02x%02x%02x%02x%02x%02x%02x", TOPIC_PREFIX,
-		extAddress.m8[0],
-		extAddress.m8[1],
-		extAddress.m8[2],
-		extAddress.m8[3],
-		extAddress.m8[4],
-		extAddress.m8[5],
-		extAddress.m8[6],
-		extAddress.m8[7]
-        );
+    while (k_msgq_get(&_storeQueue, &record, K_NO_WAIT) == 0)
+    {
+        mqttsnStorePush(&record);
+    }
+}
+#endif
 
-        LOG_DBG("Registering Topic: %s", data);
+#if defined(CONFIG_MQTT_SNCLIENT_SLEEP)
+// Go back to sleep once nothing is left to send in this publish cycle
+static void mqttsnSleepEnter(otInstance *instance)
+{
+    otMqttsnClientState state = otMqttsnGetState(instance);
 
-        // Obtain target topic ID
-        otMqttsnRegister(instance, data, mqttsnHandleRegistered, (void *)instance);
+    if (!atomic_get(&_sleepEnabled) || atomic_get(&_inFlight) > 0)
+    {
+        return;
     }
-    else
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    if (mqttsnStorePending() > 0)
     {
-        switch(aCode)
+        return;
+    }
+#endif
+    if (state != kStateActive && state != kStateAwake)
+    {
+        return;
+    }
+
+    // DISCONNECT with a duration, the gateway buffers downlink until the next wake
+    otError err = otMqttsnSleep(instance, CONFIG_MQTT_SNCLIENT_SLEEP_DURATION_S);
+    if (err != OT_ERROR_NONE)
+    {
+        LOG_WRN("Sleep failed: %d", err);
+        return;
+    }
+
+    if (_wakeStart != 0)
+    {
+        uint32_t wakeTime = (uint32_t)(k_uptime_get() - _wakeStart);
+        _wakeStart = 0;
+
+        _stats.wakeCycles++;
+        _stats.wakeTimeLastMs = wakeTime;
+        _stats.wakeTimeTotalMs += wakeTime;
+        _stats.wakeTimeMaxMs = MAX(_stats.wakeTimeMaxMs, wakeTime);
+        LOG_INF("Awake for %u ms", wakeTime);
+    }
+}
+
+static void mqttsnSleepWorkHandler(struct k_work *work)
+{
+    mqttsnWorkStarted(MQTTSN_WORK_SLEEP);
+
+    mqttsnApiLock();
+    mqttsnSleepEnter(openthread_get_default_instance());
+    mqttsnApiUnlock();
+}
+#endif
+
+static void mqttsnIdle(void)
+{
+    if (atomic_get(&_inFlight) == 0)
+    {
+        coexThreadRelease();
+    }
+
+#if defined(CONFIG_MQTT_SNCLIENT_SLEEP)
+    if (atomic_get(&_sleepEnabled))
+    {
+        mqttsnWorkSchedule(MQTTSN_WORK_SLEEP, &mqttsnSleepWork, 0);
+    }
+#endif
+}
+
+static struct mqttsnInFlight *mqttsnWindowAlloc(void)
+{
+    struct mqttsnInFlight *slot = NULL;
+
+    k_mutex_lock(&_windowLock, K_FOREVER);
+    for (size_t i = 0; i < ARRAY_SIZE(_window); i++)
+    {
+        if (_window[i].state == MQTTSN_SLOT_FREE)
         {
-            case kCodeAccepted:
-                    break;
-            case kCodeRejectedCongestion:
-                    LOG_WRN("HandleConnected - kCodeRejectedCongestion");
-                    break;
-            case kCodeRejectedTopicId:
-                    LOG_WRN("HandleConnected - kCodeRejectedTopicId");
-                    break;
-            case kCodeRejectedNotSupported:
-                    LOG_WRN("HandleConnected - kCodeRejectedNotSupported");
-                    break;
-            case kCodeTimeout:
-                    LOG_WRN("HandleConnected - kCodeTimeout");
-                    break;
+            slot = &_window[i];
+            slot->state = MQTTSN_SLOT_SENT;
+            slot->retransmits = 0;
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+            slot->recordCount = 0;
+            slot->stored = false;
+#endif
+            // Zero is never used so a stale context cannot match a slot
+            if (++_nextMsgId == 0)
+            {
+                _nextMsgId = 1;
+            }
+            slot->msgId = _nextMsgId;
+            atomic_inc(&_inFlight);
+            break;
         }
     }
+    k_mutex_unlock(&_windowLock);
+
+    return slot;
 }
 
-static void mqttsnHandleSearchGw(const otIp6Address* aAddress, uint8_t aGatewayId, void* aContext)
+static struct mqttsnInFlight *mqttsnWindowFind(uint16_t msgId)
 {
-    OT_UNUSED_VARIABLE(aGatewayId);
+    struct mqttsnInFlight *slot = NULL;
 
-    LOG_DBG("Got search gateway response");
+    k_mutex_lock(&_windowLock, K_FOREVER);
+    for (size_t i = 0; i < ARRAY_SIZE(_window); i++)
+    {
+        if (_window[i].state == MQTTSN_SLOT_SENT && _window[i].msgId == msgId)
+        {
+            slot = &_window[i];
+            break;
+        }
+    }
+    k_mutex_unlock(&_windowLock);
 
-    // Handle SEARCHGW response received
-    // Connect to received address
-    otInstance *instance = (otInstance *)aContext;
-    otIp6Address address = *aAddress;
-    // Set MQTT-SN client configuration settings
-    otMqttsnConfig config;
+    return slot;
+}
 
-    otExtAddress extAddress;
-    otLinkGetFactoryAssignedIeeeEui64(instance, &extAddress);
+static void mqttsnWindowRelease(struct mqttsnInFlight *slot)
+{
+    k_mutex_lock(&_windowLock, K_FOREVER);
+    slot->state = MQTTSN_SLOT_FREE;
+    k_mutex_unlock(&_windowLock);
 
-    char data[256];
-    sprintf(data, "%s-%02x%02x%02x%02x%02x%02x%02x%02x", CLIENT_PREFIX,
-                extAddress.m8[0],
-                extAddress.m8[1],
-                extAddress.m8[2],
-                extAddress.m8[3],
-                extAddress.m8[4],
-                extAddress.m8[5],
-                extAddress.m8[6],
-                extAddress.m8[7]
-    );
-
-    config.mClientId = data;
-    config.mKeepAlive = 30;
-    config.mCleanSession = true;
-    config.mPort = GATEWAY_MULTICAST_PORT;
-    config.mAddress = &address;
-    config.mRetransmissionCount = 3;
-    config.mRetransmissionTimeout = 10;
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    // A slot opened up, keep the backlog moving
+    if (mqttsnStorePending() > 0)
+    {
+        mqttsnWorkSchedule(MQTTSN_WORK_DRAIN, &mqttsnDrainWork, 0);
+    }
+#endif
 
-    // Register connected callback
-    otMqttsnSetConnectedHandler(instance, mqttsnHandleConnected, (void *)instance);
-    // Connect to the MQTT broker (gateway)
-    otMqttsnConnect(instance, &config);
+    if (atomic_dec(&_inFlight) == 1)
+    {
+        mqttsnIdle();
+    }
 }
 
-void mqttsnSearchGateway(otInstance *instance)
+// Publication finished, a stored sample is deleted from the drain work, not this context
+static void mqttsnWindowDone(struct mqttsnInFlight *slot)
 {
-    otIp6Address address;
-    otIp6AddressFromString(GATEWAY_MULTICAST_ADDRESS, &address);
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    if (slot->stored)
+    {
+        k_mutex_lock(&_windowLock, K_FOREVER);
+        slot->state = MQTTSN_SLOT_ACKED;
+        k_mutex_unlock(&_windowLock);
+        mqttsnWorkSchedule(MQTTSN_WORK_DRAIN, &mqttsnDrainWork, 0);
+        return;
+    }
+#endif
 
-    LOG_DBG("Searching for gateway on %s", GATEWAY_MULTICAST_ADDRESS);
+    mqttsnWindowRelease(slot);
+}
 
-    otMqttsnSetSearchgwHandler(instance, mqttsnHandleSearchGw, (void *)instance);
-    // Send SEARCHGW multicast message
-    otMqttsnSearchGateway(instance, &address, GATEWAY_MULTICAST_PORT, GATEWAY_MULTICAST_RADIUS);
+static otError mqttsnWindowSend(otInstance *instance, struct mqttsnInFlight *slot)
+{
+    slot->sentTime = k_uptime_get();
+
+    // The slot's message ID comes back as the callback context
+    otError err = otMqttsnPublish(instance, slot->data, slot->length, slot->qos, false, &_aTopic,
+        mqttsnHandlePublished, (void *)(uintptr_t)slot->msgId);
+    if (err == OT_ERROR_NONE)
+    {
+        _stats.txBytes += slot->length + MQTTSN_PUBLISH_OVERHEAD;
+    }
+
+    return err;
 }
 
-void mqttsnPublishWorkHandler(struct k_work *work)
+// Publish without waiting for earlier PUBACKs, OT_ERROR_BUSY when the window is full
+static otError mqttsnPublishData(otInstance *instance, const uint8_t *data, int32_t length,
+    const struct payloadRecord *requeue, size_t requeueCount, const uint32_t *storeSeq)
 {
-    static int count = 0;
+    struct mqttsnInFlight *slot = mqttsnWindowAlloc();
+    if (slot == NULL)
+    {
+        return OT_ERROR_BUSY;
+    }
+
+    memcpy(slot->data, data, length);
+    slot->length = length;
+    slot->qos = _qos;
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    __ASSERT_NO_MSG(requeueCount <= ARRAY_SIZE(slot->records));
+    if (requeue != NULL)
+    {
+        memcpy(slot->records, requeue, requeueCount * sizeof(*requeue));
+        slot->recordCount = requeueCount;
+    }
+    if (storeSeq != NULL)
+    {
+        slot->stored = true;
+        slot->storeSeq = *storeSeq;
+    }
+#else
+    ARG_UNUSED(requeue);
+    ARG_UNUSED(requeueCount);
+    ARG_UNUSED(storeSeq);
+#endif
 
-	LOG_DBG("Publish Handler %d", _stateCount);
+    otError err = mqttsnWindowSend(instance, slot);
+    LOG_DBG("Publishing msg %u, %d bytes rsp %d", slot->msgId, length, err);
+    if (err != OT_ERROR_NONE)
+    {
+        mqttsnWindowRelease(slot);
+    }
+    else if (slot->qos == kQos0)
+    {
+        // No PUBACK will come, the slot is done once sent
+        _stats.published++;
+        mqttsnWindowDone(slot);
+    }
+
+    return err;
+}
+
+static void mqttsnPublishCompleted(uint32_t latency)
+{
+    int64_t now = k_uptime_get();
 
-	otInstance *instance = openthread_get_default_instance();
+    bootMark(BOOT_FIRST_PUBACK);
 
-#if 0
-    _stateCount++;
+    _stats.published++;
+    _stats.pubackLatencyLastMs = latency;
+    _stats.pubackLatencyTotalMs += latency;
+    _stats.pubackLatencyMaxMs = MAX(_stats.pubackLatencyMaxMs, latency);
 
-    if(_stateCount == 3)
+    // Acknowledged messages per second over the last rate period
+    _rateCount++;
+    if (_rateStart == 0)
     {
-    	LOG_WRN("*** STOP THREAD");
-        otThreadSetEnabled(instance, false);
-        k_timer_start(&mqttsn_publish_timer, K_SECONDS(10), K_NO_WAIT);
-        return;
+        _rateStart = now;
     }
-    if(_stateCount == 6)
+    else if (now - _rateStart >= MQTTSN_RATE_PERIOD_MS)
     {
-    	LOG_WRN("*** START BLUETOOTH SCAN");
-    	bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-        k_timer_start(&mqttsn_publish_timer, K_SECONDS(10), K_NO_WAIT);
-        return;
+        _stats.publishRateMilli = (uint32_t)((uint64_t)_rateCount * 1000 * 1000 / (now - _rateStart));
+        _rateStart = now;
+        _rateCount = 0;
     }
+}
+
+static void mqttsnHandlePublished(otMqttsnReturnCode aCode, void* aContext)
+{
+    otInstance *instance = openthread_get_default_instance();
+    uint16_t msgId = (uint16_t)(uintptr_t)aContext;
+    struct mqttsnInFlight *slot = mqttsnWindowFind(msgId);
 
-    if(_stateCount == 9)
+    if (slot == NULL)
     {
-    	LOG_WRN("*** STOPPING BLUETOOTH SCAN");
-        bt_scan_stop();
-        k_timer_start(&mqttsn_publish_timer, K_SECONDS(10), K_NO_WAIT);
+        LOG_WRN("PUBACK for unknown msg %u", msgId);
         return;
     }
-    if(_stateCount == 12)
+
+    if (aCode == kCodeAccepted)
     {
-    	LOG_WRN("*** STARTING THREAD");    
-        otThreadSetEnabled(instance, true);
-        stateCount = 0;
-        k_timer_start(&mqttsn_publish_timer, K_SECONDS(10), K_NO_WAIT);
+        uint32_t latency = (uint32_t)(k_uptime_get() - slot->sentTime);
+        LOG_DBG("Published msg %u in %u ms", msgId, latency);
+        mqttsnPublishCompleted(latency);
+        mqttsnWindowDone(slot);
         return;
     }
-#endif
 
-    otMqttsnClientState state = otMqttsnGetState(instance);
+    if (aCode == kCodeTimeout)
+    {
+        _stats.timeouts++;
+    }
 
-    switch(state)
+    if (slot->retransmits < CONFIG_MQTT_SNCLIENT_PUBLISH_RETRIES &&
+        mqttsnCanPublish(otMqttsnGetState(instance)) && _topicReady)
     {
-        case kStateDisconnected:
-            LOG_INF("Client is not connected to gateway");
-            break;
-        case kStateActive:
-            LOG_INF("Client is connected to gateway and currently alive.");
-            break;
-        case kStateAsleep:
-            LOG_INF("Client is in sleeping state.");
-            break;
-        case kStateAwake:
-            LOG_INF("Client is awaken from sleep.");
-            break;
-        case kStateLost:
-            LOG_INF("Client connection is lost due to communication error.");
-            break;
+        slot->retransmits++;
+        _stats.retransmits++;
+        LOG_WRN("Publish of msg %u failed (%d), retransmit %u", msgId, aCode, slot->retransmits);
+        if (mqttsnWindowSend(instance, slot) == OT_ERROR_NONE)
+        {
+            return;
+        }
     }
 
-    if(state == kStateDisconnected || otMqttsnGetState(instance)  == kStateLost)
+    LOG_WRN("Publish of msg %u failed (%d)", msgId, aCode);
+    _stats.failed++;
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    if (slot->recordCount > 0 || slot->stored)
     {
-        LOG_WRN("MQTT g/w disconnected or lost: %d", otMqttsnGetState(instance) );
-        mqttsnSearchGateway(instance);
+        // Flash writes stay out of the OpenThread context, the drain work stores it
+        k_mutex_lock(&_windowLock, K_FOREVER);
+        slot->state = MQTTSN_SLOT_FAILED;
+        k_mutex_unlock(&_windowLock);
+        mqttsnWorkSchedule(MQTTSN_WORK_DRAIN, &mqttsnDrainWork, 0);
+        return;
     }
-    else
+#endif
+#if defined(CONFIG_MQTT_SNCLIENT_REPORT_BY_EXCEPTION)
+    // The broker may not have the last report, send the next samples regardless
+    for (size_t i = 0; i < ARRAY_SIZE(_reported); i++)
     {
-        // Get ID
-        otExtAddress extAddress;
-        otLinkGetFactoryAssignedIeeeEui64(instance, &extAddress);
+        _reported[i].valid = false;
+    }
+#endif
+    mqttsnWindowRelease(slot);
+}
 
-// Disable Bluetooth for now
-//        struct ble_lns_loc_speed_s *lns_data = bt_lns_get_last_location_and_speed(&lns);
+static const struct mqttsnParam *mqttsnParamFind(const char *name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(_params); i++)
+    {
+        if (strcmp(name, _params[i].name) == 0)
+        {
+            return &_params[i];
+        }
+    }
 
-        uint32_t latitude = 0;
-        uint32_t longitude = 0;
-        uint32_t elevation = 0;
-        uint8_t battery = 100;
-        char *triage_state = "P1";
+    return NULL;
+}
 
-        // Publish message to the registered topic
-        LOG_INF("Publishing...");
-        const char* strdata = "{\"id\":%02x%02x%02x%02x%02x%02x%02x%02x, \"count\":%d, \"status\":%s, \"batt\":%d, \"lat\":%d, \"lon\",%d, \"ele\":%d, \"temp\":24.0}";
-        char data[256];
-        sprintf(data, strdata,
-		    extAddress.m8[0],
-		    extAddress.m8[1],
-		    extAddress.m8[2],
-		    extAddress.m8[3],
-		    extAddress.m8[4],
-		    extAddress.m8[5],
-		    extAddress.m8[6],
-		    extAddress.m8[7],
-		    count++, 
-            triage_state, 
-            battery,
-            latitude,
-            longitude,
-            elevation);
-        
-        int32_t length = strlen(data);
+#if defined(CONFIG_SETTINGS)
+static int mqttsnConfigLoad(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    if (strcmp(name, MQTTSN_CONFIG_GATEWAY) == 0)
+    {
+        char address[OT_IP6_ADDRESS_STRING_SIZE];
+        if (len < sizeof(address) && read_cb(cb_arg, address, len) == len)
+        {
+            address[len] = '\0';
+            strcpy(_gatewayAddress, address);
+        }
+        return 0;
+    }
 
-        otError err = otMqttsnPublish(instance, (const uint8_t*)data, length, kQos1, false, &_aTopic,
-            mqttsnHandlePublished, NULL);
+    const struct mqttsnParam *param = mqttsnParamFind(name);
+    if (param == NULL)
+    {
+        return -ENOENT;
+    }
 
-        LOG_DBG("Publishing %d bytes rsp %d", length, err);
+    // Values outside the current limits keep the default
+    uint32_t value;
+    if (len == sizeof(value) && read_cb(cb_arg, &value, sizeof(value)) == sizeof(value) &&
+        value >= param->min && value <= param->max)
+    {
+        *param->value = value;
     }
 
-    // Restart timer
-    k_timer_start(&mqttsnPublishTimer, K_SECONDS(10), K_NO_WAIT);
+    return 0;
 }
 
-K_WORK_DEFINE(mqttsnPublishWork, mqttsnPublishWorkHandler);
-
-void mqttsnPublishHandler(struct k_timer *dummy)
+static int mqttsnSettingsSet(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
 {
-    k_work_submit(&mqttsnPublishWork);
+    const char *next;
+
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+    if (settings_name_steq(name, "gw", NULL))
+    {
+        if (len == sizeof(_gatewayCache) &&
+            read_cb(cb_arg, &_gatewayCache, sizeof(_gatewayCache)) == sizeof(_gatewayCache))
+        {
+            _gatewayCacheValid = true;
+        }
+        return 0;
+    }
+#endif
+    if (settings_name_steq(name, "cfg", &next) && next != NULL)
+    {
+        return mqttsnConfigLoad(next, len, read_cb, cb_arg);
+    }
+
+    return -ENOENT;
 }
 
-otError mqttsnInit()
+SETTINGS_STATIC_HANDLER_DEFINE(mqttsn, "mqttsn", NULL, mqttsnSettingsSet, NULL, NULL);
+#endif
+
+static void mqttsnConfigSave(const char *name, const void *value, size_t len)
 {
-    otInstance *instance = openthread_get_default_instance();
+#if defined(CONFIG_SETTINGS)
+    char key[SETTINGS_MAX_NAME_LEN];
+    snprintk(key, sizeof(key), "mqttsn/cfg/%s", name);
+
+    int err = value != NULL ? settings_save_one(key, value, len) : settings_delete(key);
+    if (err)
+    {
+        LOG_WRN("Saving %s failed (err %d)", name, err);
+    }
+#else
+    ARG_UNUSED(name);
+    ARG_UNUSED(value);
+    ARG_UNUSED(len);
+#endif
+}
+
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+static void mqttsnGatewayCacheSave(const struct mqttsnGateway *gateway)
+{
+    _gatewayCacheFailed = false;
+
+    // Only write flash when the gateway actually changed
+    if (_gatewayCacheValid && memcmp(&_gatewayCache, gateway, sizeof(_gatewayCache)) == 0)
+    {
+        return;
+    }
+
+    _gatewayCache = *gateway;
+    _gatewayCacheValid = true;
+
+    int err = settings_save_one("mqttsn/gw", &_gatewayCache, sizeof(_gatewayCache));
+    if (err)
+    {
+        LOG_WRN("Gateway cache write failed (err %d)", err);
+    }
+}
+#endif
+
+// Topic is usable, start sending anything stored while offline
+static void mqttsnTopicReady(void)
+{
+    _topicReady = true;
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    mqttsnWorkSchedule(MQTTSN_WORK_DRAIN, &mqttsnDrainWork, 0);
+#endif
+
+    // The first status sample after boot does not wait for the stream phase
+    struct mqttsnStream *status = &_streams[MQTTSN_WORK_STATUS];
+    if (!_publishedOnce && _streamsStarted && status->periodMs != 0)
+    {
+        _publishedOnce = true;
+        mqttsnWorkSubmit(MQTTSN_WORK_STATUS, &status->work);
+    }
+}
+
+#if defined(CONFIG_MQTT_SNCLIENT_TOPIC_NAME)
+static void mqttsnHandleRegistered(otMqttsnReturnCode aCode, const otMqttsnTopic* aTopic, void* aContext)
+{
+    // Handle registered
+//    otInstance *instance = (otInstance *)aContext;
+    if (aCode == kCodeAccepted)
+    {
+        LOG_DBG("HandleRegistered - OK");
+        memcpy(&_aTopic, aTopic, sizeof(otMqttsnTopic));
+        mqttsnTopicReady();
+    }
+    else
+    {
+        LOG_WRN("HandleRegistered - Error");
+    }
+}
+#endif
+
+static void mqttsnHandleConnected(otMqttsnReturnCode aCode, void* aContext)
+{
+    // Handle connected
+    otInstance *instance = (otInstance *)aContext;
+    _connecting = false;
+
+    if (aCode == kCodeAccepted)
+    {
+        LOG_DBG("HandleConnected -Accepted");
+
+        if (_connectedOnce)
+        {
+            _stats.reconnects++;
+        }
+        _connectedOnce = true;
+        bootMark(BOOT_GATEWAY);
+
+        // Reachable gateway, next outage starts again from the shortest backoff
+        _searchBackoffMs = CONFIG_MQTT_SNCLIENT_SEARCH_BACKOFF_MIN_MS;
+        _searchNextTime = 0;
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+        if (_connectFromCache)
+        {
+            _stats.cacheHits++;
+        }
+        mqttsnGatewayCacheSave(&_gateway);
+#endif
+
+#if defined(CONFIG_MQTT_SNCLIENT_TOPIC_NAME)
+        LOG_DBG("Registering Topic: %s", _topicName);
+
+        // Obtain target topic ID
+        otMqttsnRegister(instance, _topicName, mqttsnHandleRegistered, (void *)instance);
+#else
+        OT_UNUSED_VARIABLE(instance);
+
+        // Topic is known to the gateway already, no REGISTER round trip
+        mqttsnTopicReady();
+#endif
+    }
+    else
+    {
+        switch(aCode)
+        {
+            case kCodeAccepted:
+                    break;
+            case kCodeRejectedCongestion:
+                    LOG_WRN("HandleConnected - kCodeRejectedCongestion");
+                    break;
+            case kCodeRejectedTopicId:
+                    LOG_WRN("HandleConnected - kCodeRejectedTopicId");
+                    break;
+            case kCodeRejectedNotSupported:
+                    LOG_WRN("HandleConnected - kCodeRejectedNotSupported");
+                    break;
+            case kCodeTimeout:
+                    LOG_WRN("HandleConnected - kCodeTimeout");
+                    break;
+        }
+
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+        if (_connectFromCache)
+        {
+            // Fall back to SEARCHGW until a gateway accepts us again
+            LOG_WRN("Cached gateway %d not reachable", _gateway.gatewayId);
+            _gatewayCacheFailed = true;
+        }
+#endif
+    }
+}
+
+static void mqttsnConnectGateway(otInstance *instance, const otIp6Address *aAddress, uint8_t aGatewayId)
+{
+    // Set MQTT-SN client configuration settings
+    otMqttsnConfig config;
+
+    _gateway.address = *aAddress;
+    _gateway.gatewayId = aGatewayId;
+
+    config.mClientId = _clientId;
+    config.mKeepAlive = _keepAliveS;
+    config.mCleanSession = true;
+    config.mPort = GATEWAY_MULTICAST_PORT;
+    config.mAddress = &_gateway.address;
+    config.mRetransmissionCount = _retransmissionCount;
+    config.mRetransmissionTimeout = _retransmissionTimeoutS;
+
+    // Register connected callback
+    otMqttsnSetConnectedHandler(instance, mqttsnHandleConnected, (void *)instance);
+    // Connect to the MQTT broker (gateway)
+    _connecting = (otMqttsnConnect(instance, &config) == OT_ERROR_NONE);
+}
+
+static void mqttsnHandleSearchGw(const otIp6Address* aAddress, uint8_t aGatewayId, void* aContext)
+{
+    LOG_DBG("Got search gateway response from %d", aGatewayId);
+
+    // Handle SEARCHGW response received
+    // Connect to received address
+    otInstance *instance = (otInstance *)aContext;
+
+    // Several gateways may answer one SEARCHGW, connect to the first only
+    if (_connecting)
+    {
+        LOG_DBG("Connect to gateway %d in progress, ignoring %d", _gateway.gatewayId, aGatewayId);
+        return;
+    }
+
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+    _connectFromCache = false;
+#endif
+    mqttsnConnectGateway(instance, aAddress, aGatewayId);
+}
+
+void mqttsnSearchGateway(otInstance *instance)
+{
+    if (_connecting)
+    {
+        LOG_DBG("Connect to gateway %d in progress", _gateway.gatewayId);
+        return;
+    }
+
+    _topicReady = false;
+
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+    if (_gatewayCacheValid && !_gatewayCacheFailed)
+    {
+        // Unicast CONNECT to the last gateway, no multicast needed
+        LOG_DBG("Connecting to cached gateway %d", _gatewayCache.gatewayId);
+        _connectFromCache = true;
+        mqttsnConnectGateway(instance, &_gatewayCache.address, _gatewayCache.gatewayId);
+        return;
+    }
+#endif
+
+    int64_t now = k_uptime_get();
+    if (now < _searchNextTime)
+    {
+        LOG_DBG("SEARCHGW backoff, %d ms left", (int)(_searchNextTime - now));
+        return;
+    }
+
+    otIp6Address address;
+    k_mutex_lock(&_configLock, K_FOREVER);
+    otIp6AddressFromString(_gatewayAddress, &address);
+    LOG_DBG("Searching for gateway on %s", _gatewayAddress);
+    k_mutex_unlock(&_configLock);
+
+    otMqttsnSetSearchgwHandler(instance, mqttsnHandleSearchGw, (void *)instance);
+    // Send SEARCHGW multicast message
+    otMqttsnSearchGateway(instance, &address, GATEWAY_MULTICAST_PORT, _hops);
+    _stats.searches++;
+
+    // Randomized exponential backoff so nodes that lost the gateway together
+    // do not keep searching in lockstep
+    uint32_t backoff = _searchBackoffMs;
+    _searchNextTime = now + backoff / 2 + sys_rand32_get() % (backoff / 2 + 1);
+    _searchBackoffMs = MIN(backoff * 2, CONFIG_MQTT_SNCLIENT_SEARCH_BACKOFF_MAX_MS);
+}
+
+// Partition merges and router upgrades flip the role several times within
+// seconds, only the role that holds for _roleStableMs is acted on
+static void mqttsnRoleChanged(otInstance *instance, otChangedFlags flags)
+{
+    uint32_t due = (uint32_t)k_uptime_ticks() + k_ms_to_ticks_ceil32(_roleStableMs);
+
+    if (k_work_delayable_is_pending(&mqttsnRoleWork))
+    {
+        _stats.roleFlaps++;
+    }
+
+    k_work_reschedule_for_queue(&mqttsnWorkQueue, &mqttsnRoleWork, K_MSEC(_roleStableMs));
+    _workDue[MQTTSN_WORK_ROLE] = due;
+}
+
+#if defined(CONFIG_OPENTHREAD_PING_SENDER)
+static void mqttsnProbeDone(const otPingSenderStatistics *aStatistics, void *aContext)
+{
+    otInstance *instance = (otInstance *)aContext;
+
+    _probing = false;
+    if (aStatistics->mReceivedCount > 0)
+    {
+        LOG_DBG("Gateway %d answered, keeping it", _gateway.gatewayId);
+        _stats.searchesSuppressed++;
+        return;
+    }
+
+    LOG_WRN("Gateway %d did not answer after the role change", _gateway.gatewayId);
+    _stats.probesFailed++;
+    mqttsnSearchGateway(instance);
+}
+
+// One echo request to the gateway, mqttsnProbeDone gets the result
+static otError mqttsnProbeGateway(otInstance *instance)
+{
+    otPingSenderConfig config;
+
+    memset(&config, 0, sizeof(config));
+    config.mDestination = _gateway.address;
+    config.mStatisticsCallback = mqttsnProbeDone;
+    config.mCallbackContext = instance;
+    config.mCount = 1;
+    config.mTimeout = CONFIG_MQTT_SNCLIENT_ROLE_PROBE_TIMEOUT_MS;
+
+    otError err = otPingSenderPing(instance, &config);
+    if (err == OT_ERROR_NONE)
+    {
+        _probing = true;
+        _stats.probes++;
+    }
+
+    return err;
+}
+#endif
+
+// A role change alone does not lose the gateway, but the client only notices a lost
+// one at its next keepalive or publication, and not at all while asleep. Ask the
+// gateway directly and search only when it does not answer.
+static void mqttsnRoleCheck(otInstance *instance)
+{
+    otDeviceRole role = otThreadGetDeviceRole(instance);
+
+    if (role != OT_DEVICE_ROLE_CHILD && role != OT_DEVICE_ROLE_ROUTER && role != OT_DEVICE_ROLE_LEADER)
+    {
+        LOG_DBG("Not attached, gateway check deferred to the next attach");
+        return;
+    }
+
+    otMqttsnClientState state = otMqttsnGetState(instance);
+    if (mqttsnCanPublish(state) || state == kStateAsleep)
+    {
+#if defined(CONFIG_OPENTHREAD_PING_SENDER)
+        if (_probing)
+        {
+            LOG_DBG("Gateway probe in progress");
+            return;
+        }
+
+        otError err = mqttsnProbeGateway(instance);
+        if (err == OT_ERROR_NONE)
+        {
+            LOG_DBG("Role %d stable, probing gateway %d", role, _gateway.gatewayId);
+            return;
+        }
+        LOG_WRN("Gateway probe not sent: %d", err);
+#endif
+    }
+
+    mqttsnSearchGateway(instance);
+}
+
+static void mqttsnRoleWorkHandler(struct k_work *work)
+{
+    mqttsnWorkStarted(MQTTSN_WORK_ROLE);
+
+    mqttsnApiLock();
+    mqttsnRoleCheck(openthread_get_default_instance());
+    mqttsnApiUnlock();
+}
+
+static struct stateSubscriber _roleSubscriber = {
+    .mask = OT_CHANGED_THREAD_ROLE,
+    .handler = mqttsnRoleChanged,
+};
+
+void mqttsnSetSleepEnabled(bool enabled)
+{
+#if defined(CONFIG_MQTT_SNCLIENT_SLEEP)
+    LOG_INF("MQTT-SN sleep %s", enabled ? "enabled" : "disabled");
+    atomic_set(&_sleepEnabled, enabled);
+    mqttsnIdle();
+#else
+    ARG_UNUSED(enabled);
+#endif
+}
+
+void mqttsnGetStats(struct mqttsnStats *stats)
+{
+    memcpy(stats, &_stats, sizeof(*stats));
+    stats->fixOverruns = appbluetoothGetOverruns();
+    stats->inFlight = atomic_get(&_inFlight);
+}
+
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_COMPARE)
+static void mqttsnComparePayloads(const struct payloadRecord *record)
+{
+    uint8_t data[PAYLOAD_MAX_SIZE];
+
+    uint32_t start = k_cycle_get_32();
+    int jsonLength = payloadEncodeJson(record, data, sizeof(data));
+    uint32_t jsonCycles = k_cycle_get_32() - start;
+
+    start = k_cycle_get_32();
+    int cborLength = payloadEncodeCbor(record, data, sizeof(data));
+    uint32_t cborCycles = k_cycle_get_32() - start;
+
+    LOG_INF("Payload JSON %d bytes %u cycles, CBOR %d bytes %u cycles",
+        jsonLength, jsonCycles, cborLength, cborCycles);
+}
+#endif
+
+static void mqttsnBuildRecord(otInstance *instance, struct payloadRecord *record)
+{
+    static uint32_t count = 0;
+
+    // Get ID
+    otExtAddress extAddress;
+    otLinkGetFactoryAssignedIeeeEui64(instance, &extAddress);
+
+    memset(record, 0, sizeof(*record));
+    memcpy(record->id, extAddress.m8, sizeof(record->id));
+    record->count = count++;
+    strcpy(record->status, "P1");
+    record->battery = 100;
+    // Last fix from the location stream, tagged with the tag that sent it
+    if (_fixValid)
+    {
+        record->latitude = _fix.data.latitude;
+        record->longitude = _fix.data.longitude;
+        record->elevation = _fix.data.elevation_present ? _fix.data.elevation : 0;
+        memcpy(record->peer, _fix.peer.a.val, sizeof(record->peer));
+    }
+    record->temperature = 2400;
+}
+
+static void mqttsnFormatEui64(char *dst, const otExtAddress *extAddress)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < sizeof(extAddress->m8); i++)
+    {
+        *dst++ = hex[extAddress->m8[i] >> 4];
+        *dst++ = hex[extAddress->m8[i] & 0x0f];
+    }
+    *dst = '\0';
+}
+
+// Build the client ID and topic name once, they only depend on the EUI-64
+static void mqttsnInitIdentity(otInstance *instance)
+{
+    otExtAddress extAddress;
+    otLinkGetFactoryAssignedIeeeEui64(instance, &extAddress);
+
+    // <prefix>-<eui64>
+    strcpy(_clientId, CLIENT_PREFIX "-");
+    mqttsnFormatEui64(&_clientId[sizeof(CLIENT_PREFIX)], &extAddress);
+
+#if defined(CONFIG_MQTT_SNCLIENT_TOPIC_NAME)
+    // <prefix>/<eui64>
+    strcpy(_topicName, TOPIC_PREFIX "/");
+    mqttsnFormatEui64(&_topicName[sizeof(TOPIC_PREFIX)], &extAddress);
+    LOG_INF("Client %s topic %s", _clientId, _topicName);
+#elif defined(CONFIG_MQTT_SNCLIENT_TOPIC_SHORT)
+    _aTopic = otMqttsnCreateShortTopicName(_shortTopicName);
+    LOG_INF("Client %s short topic %s", _clientId, _shortTopicName);
+#else
+    _aTopic = otMqttsnCreatePredefinedTopicId(CONFIG_MQTT_SNCLIENT_TOPIC_PREDEFINED_ID);
+    LOG_INF("Client %s predefined topic %d", _clientId, CONFIG_MQTT_SNCLIENT_TOPIC_PREDEFINED_ID);
+#endif
+}
+
+// OT_ERROR_INVALID_ARGS when the record cannot be encoded, anything else comes from sending
+static otError mqttsnPublishRecord(otInstance *instance, const struct payloadRecord *record,
+    const struct payloadRecord *requeue, const uint32_t *storeSeq)
+{
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_COMPARE)
+    mqttsnComparePayloads(record);
+#endif
+
+    // Publish message to the registered topic
+    PERF_PROBE_BEGIN(PERF_MQTTSN_PUBLISH);
+    uint32_t start = k_cycle_get_32();
+    LOG_DBG("Publishing...");
+    uint8_t data[PAYLOAD_MAX_SIZE];
+    otError err = OT_ERROR_INVALID_ARGS;
+    int32_t length = payloadEncode(record, data, sizeof(data));
+    if (length < 0)
+    {
+        LOG_ERR("Payload encoding failed");
+    }
+    else
+    {
+        err = mqttsnPublishData(instance, data, length, requeue, requeue != NULL ? 1 : 0, storeSeq);
+    }
+
+    _stats.publishCyclesLast = k_cycle_get_32() - start;
+    _stats.publishCyclesMax = MAX(_stats.publishCyclesMax, _stats.publishCyclesLast);
+    PERF_PROBE_END(PERF_MQTTSN_PUBLISH);
+
+    return err;
+}
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+// Finish what the OpenThread context left to the drain work, both write flash
+static void mqttsnWindowSettle(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(_window); i++)
+    {
+        if (_window[i].state == MQTTSN_SLOT_ACKED)
+        {
+            mqttsnStoreAck(_window[i].storeSeq);
+            mqttsnWindowRelease(&_window[i]);
+        }
+        else if (_window[i].state == MQTTSN_SLOT_FAILED)
+        {
+            if (_window[i].stored)
+            {
+                // Still in flash, sent again in order from the oldest one
+                _drainRewind = true;
+            }
+            for (size_t j = 0; j < _window[i].recordCount; j++)
+            {
+                mqttsnStorePush(&_window[i].records[j]);
+            }
+            mqttsnWindowRelease(&_window[i]);
+        }
+    }
+}
+
+static bool mqttsnWindowStoredPending(void)
+{
+    bool pending = false;
+
+    k_mutex_lock(&_windowLock, K_FOREVER);
+    for (size_t i = 0; i < ARRAY_SIZE(_window); i++)
+    {
+        if (_window[i].state != MQTTSN_SLOT_FREE && _window[i].stored)
+        {
+            pending = true;
+            break;
+        }
+    }
+    k_mutex_unlock(&_windowLock);
+
+    return pending;
+}
+
+static void mqttsnDrainWorkHandler(struct k_work *work)
+{
+    mqttsnWorkStarted(MQTTSN_WORK_DRAIN);
+
+    otInstance *instance = openthread_get_default_instance();
+    struct payloadRecord record;
+    uint32_t seq;
+    int err;
+
+    mqttsnStoreQueued();
+    mqttsnWindowSettle();
+
+    mqttsnApiLock();
+    bool ready = mqttsnCanPublish(otMqttsnGetState(instance)) && _topicReady;
+    mqttsnApiUnlock();
+    if (!ready)
+    {
+        return;
+    }
+
+    if (_drainRewind)
+    {
+        // Rewind once the rest of the window has settled so nothing is sent twice,
+        // every released slot schedules the drain again
+        if (mqttsnWindowStoredPending())
+        {
+            return;
+        }
+        mqttsnStoreRewind();
+        _drainRewind = false;
+    }
+
+    // Fill the in-flight window, each sample stays in flash until its PUBACK. The lock
+    // is only held for the publication, the store writes flash and would stall the stack.
+    while ((err = mqttsnStorePeek(&record, &seq)) == 0)
+    {
+        mqttsnApiLock();
+        otError sent = mqttsnPublishRecord(instance, &record, NULL, &seq);
+        mqttsnApiUnlock();
+        if (sent == OT_ERROR_BUSY)
+        {
+            // Rescheduled when a slot is released
+            return;
+        }
+        if (sent == OT_ERROR_INVALID_ARGS)
+        {
+            // Cannot be encoded, dropped rather than block the queue
+            mqttsnStoreSent(seq);
+            mqttsnStoreAck(seq);
+            continue;
+        }
+        if (sent != OT_ERROR_NONE)
+        {
+            // Includes NO_BUFS from an exhausted message pool, the sample stays stored
+            mqttsnWorkSchedule(MQTTSN_WORK_DRAIN, &mqttsnDrainWork,
+                CONFIG_MQTT_SNCLIENT_STORE_DRAIN_INTERVAL_MS);
+            return;
+        }
+
+        mqttsnStoreSent(seq);
+    }
+
+    if (err == -EBUSY)
+    {
+        // Waiting for the oldest PUBACK, rescheduled when a slot is released
+        return;
+    }
+
+    if (mqttsnStoreCount() == 0)
+    {
+        struct mqttsnStoreStats stats;
+        mqttsnStoreGetStats(&stats);
+        LOG_INF("Store drained: queued %u drained %u dropped %u",
+            stats.queued, stats.drained, stats.dropped);
+    }
+    mqttsnIdle();
+}
+#endif
+
+#if defined(CONFIG_MQTT_SNCLIENT_BATCH)
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+static void mqttsnBatchStore(void)
+{
+    // Connection went away before the batch was sent
+    for (size_t i = 0; i < _batchCount; i++)
+    {
+        mqttsnStoreLater(&_batch[i]);
+    }
+    _batchCount = 0;
+    k_work_cancel_delayable(&mqttsnBatchWork);
+}
+#endif
+
+static otError mqttsnBatchFlush(otInstance *instance)
+{
+    uint8_t data[PAYLOAD_MAX_SIZE];
+
+    if (_batchCount == 0)
+    {
+        return OT_ERROR_NONE;
+    }
+
+    int32_t length = payloadEncodeBatch(_batch, _batchCount, data, sizeof(data));
+    if (length < 0)
+    {
+        LOG_ERR("Batch encoding failed, dropping %zu samples", _batchCount);
+        _batchCount = 0;
+        k_work_cancel_delayable(&mqttsnBatchWork);
+        return OT_ERROR_NO_BUFS;
+    }
+
+    if (length > FRAME_PAYLOAD_SIZE)
+    {
+        // Only possible for a single oversized record
+        LOG_WRN("Publishing %d bytes, frame budget is %d", length, FRAME_PAYLOAD_SIZE);
+    }
+
+    otError err = mqttsnPublishData(instance, data, length, _batch, _batchCount, NULL);
+    if (err == OT_ERROR_BUSY)
+    {
+        // Keep collecting, the age work tries again
+        LOG_DBG("Window full, holding batch of %zu samples", _batchCount);
+        mqttsnWorkSchedule(MQTTSN_WORK_BATCH, &mqttsnBatchWork, MQTTSN_WINDOW_RETRY_MS);
+        return err;
+    }
+
+    LOG_DBG("Publishing batch of %zu samples in %d bytes rsp %d", _batchCount, length, err);
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    if (err != OT_ERROR_NONE)
+    {
+        // Not sent at all, the slot copy was released with it
+        mqttsnBatchStore();
+        return err;
+    }
+#else
+    if (err != OT_ERROR_NONE)
+    {
+        LOG_WRN("Dropping batch of %zu samples", _batchCount);
+    }
+#endif
+
+    _batchCount = 0;
+    k_work_cancel_delayable(&mqttsnBatchWork);
+
+    return err;
+}
+
+// Make room in a batch that could not be flushed because the window is full
+static void mqttsnBatchOverflow(otInstance *instance)
+{
+    if (mqttsnBatchFlush(instance) == OT_ERROR_BUSY)
+    {
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+        mqttsnBatchStore();
+#else
+        LOG_WRN("Window full, dropping batch of %zu samples", _batchCount);
+        _batchCount = 0;
+        k_work_cancel_delayable(&mqttsnBatchWork);
+#endif
+    }
+}
+
+static void mqttsnBatchAdd(otInstance *instance, const struct payloadRecord *record)
+{
+    if (_batchCount == ARRAY_SIZE(_batch))
+    {
+        mqttsnBatchOverflow(instance);
+    }
+
+    _batch[_batchCount++] = *record;
+
+    // Send what was collected before if this sample no longer fits the frame
+    if (_batchCount > 1)
+    {
+        uint8_t data[PAYLOAD_MAX_SIZE];
+        int32_t length = payloadEncodeBatch(_batch, _batchCount, data, sizeof(data));
+
+        if (length < 0 || length > FRAME_PAYLOAD_SIZE)
+        {
+            _batchCount--;
+            mqttsnBatchOverflow(instance);
+            _batch[_batchCount++] = *record;
+        }
+    }
+
+    if (_batchCount == 1)
+    {
+        _batchStart = k_uptime_get();
+        mqttsnWorkSchedule(MQTTSN_WORK_BATCH, &mqttsnBatchWork, CONFIG_MQTT_SNCLIENT_BATCH_MAX_AGE_MS);
+    }
+    else if (k_uptime_get() - _batchStart >= CONFIG_MQTT_SNCLIENT_BATCH_MAX_AGE_MS)
+    {
+        // Age expired while the client was asleep
+        mqttsnBatchFlush(instance);
+    }
+}
+
+static void mqttsnBatchAge(otInstance *instance)
+{
+    otMqttsnClientState state = otMqttsnGetState(instance);
+
+    // Oldest sample in the batch reached the maximum age
+    if (state == kStateDisconnected || state == kStateLost)
+    {
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+        mqttsnBatchStore();
+#endif
+        return;
+    }
+
+    if (state == kStateAsleep)
+    {
+        // Sent when the next publish cycle wakes the client
+        return;
+    }
+
+    mqttsnBatchFlush(instance);
+}
+
+static void mqttsnBatchWorkHandler(struct k_work *work)
+{
+    mqttsnWorkStarted(MQTTSN_WORK_BATCH);
+
+    mqttsnApiLock();
+    mqttsnBatchAge(openthread_get_default_instance());
+    mqttsnApiUnlock();
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    mqttsnStoreQueued();
+#endif
+}
+#endif
+
+#if defined(CONFIG_MQTT_SNCLIENT_REPORT_BY_EXCEPTION)
+// Distance between two fixes in metres, equirectangular is plenty for a deadband
+static float mqttsnRecordDistance(const struct payloadRecord *a, const struct payloadRecord *b)
+{
+    float dy = ((float)a->latitude - b->latitude) * METRES_PER_LAT_UNIT;
+    float dx = ((float)a->longitude - b->longitude) * METRES_PER_LAT_UNIT *
+        cosf(a->latitude * RADIANS_PER_LAT_UNIT);
+    float dz = ((float)a->elevation - b->elevation) / 100.0f;
+
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+// Last report from the same location source, or the entry to reuse for it
+static struct mqttsnReported *mqttsnReportedFind(const struct payloadRecord *record)
+{
+    struct mqttsnReported *oldest = &_reported[0];
+
+    for (size_t i = 0; i < ARRAY_SIZE(_reported); i++)
+    {
+        struct mqttsnReported *reported = &_reported[i];
+
+        if (reported->valid &&
+            memcmp(reported->record.peer, record->peer, sizeof(record->peer)) == 0)
+        {
+            return reported;
+        }
+
+        if (!reported->valid || (oldest->valid && reported->time < oldest->time))
+        {
+            oldest = reported;
+        }
+    }
+
+    oldest->valid = false;
+    return oldest;
+}
+
+// True when the record differs enough from the last report or the heartbeat is due
+static bool mqttsnRecordReportable(const struct mqttsnReported *reported,
+    const struct payloadRecord *record)
+{
+    if (!reported->valid)
+    {
+        return true;
+    }
+
+    if (k_uptime_get() - reported->time >= CONFIG_MQTT_SNCLIENT_HEARTBEAT_S * MSEC_PER_SEC)
+    {
+        LOG_DBG("Heartbeat");
+        return true;
+    }
+
+    if (strncmp(record->status, reported->record.status, sizeof(record->status)) != 0)
+    {
+        LOG_DBG("Triage state changed");
+        return true;
+    }
+
+    if (ABS(record->battery - reported->record.battery) >= CONFIG_MQTT_SNCLIENT_DEADBAND_BATTERY_PCT)
+    {
+        LOG_DBG("Battery changed");
+        return true;
+    }
+
+    if (mqttsnRecordDistance(record, &reported->record) >= CONFIG_MQTT_SNCLIENT_DEADBAND_POSITION_M)
+    {
+        LOG_DBG("Position changed");
+        return true;
+    }
+
+    return false;
+}
+#endif
+
+// Hold on to a sample that cannot be sent right now
+static void mqttsnKeepRecord(const struct payloadRecord *record)
+{
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+#if defined(CONFIG_MQTT_SNCLIENT_BATCH)
+    mqttsnBatchStore();
+#endif
+    mqttsnStoreLater(record);
+#else
+    ARG_UNUSED(record);
+#endif
+}
+
+// Wake or reconnect the client for a publication, true when it can publish now
+static bool mqttsnPublishBegin(otInstance *instance)
+{
+    otMqttsnClientState state = otMqttsnGetState(instance);
+
+    switch(state)
+    {
+        case kStateDisconnected:
+            LOG_DBG("Client is not connected to gateway");
+            break;
+        case kStateActive:
+            LOG_DBG("Client is connected to gateway and currently alive.");
+            break;
+        case kStateAsleep:
+            LOG_DBG("Client is in sleeping state.");
+            break;
+        case kStateAwake:
+            LOG_DBG("Client is awaken from sleep.");
+            break;
+        case kStateLost:
+            LOG_DBG("Client connection is lost due to communication error.");
+            break;
+    }
+
+#if defined(CONFIG_MQTT_SNCLIENT_SLEEP)
+    if (state == kStateAsleep)
+    {
+        // Wake for this publish cycle, the PINGREQ makes the gateway flush buffered downlink
+        int64_t wakeStart = k_uptime_get();
+        otError err = otMqttsnAwake(instance, CONFIG_MQTT_SNCLIENT_SLEEP_AWAKE_TIMEOUT_MS);
+        if (err == OT_ERROR_NONE)
+        {
+            _wakeStart = wakeStart;
+            state = kStateAwake;
+        }
+        else
+        {
+            // Still asleep, the sample is kept and the next cycle tries again
+            LOG_WRN("Awake failed: %d", err);
+            return false;
+        }
+    }
+#endif
+
+    if(state == kStateDisconnected || otMqttsnGetState(instance)  == kStateLost)
+    {
+        LOG_WRN("MQTT g/w disconnected or lost: %d", otMqttsnGetState(instance) );
+        mqttsnSearchGateway(instance);
+        return false;
+    }
+
+    if (!_topicReady)
+    {
+        LOG_DBG("Waiting for topic registration");
+        return false;
+    }
+
+    return true;
+}
+
+// Report a sample, or keep it when the client cannot publish right now
+static void mqttsnSampleSubmit(otInstance *instance, bool ready, const struct payloadRecord *record)
+{
+#if defined(CONFIG_MQTT_SNCLIENT_REPORT_BY_EXCEPTION)
+    struct mqttsnReported *reported = mqttsnReportedFind(record);
+
+    if (!mqttsnRecordReportable(reported, record))
+    {
+        _stats.suppressed++;
+        return;
+    }
+
+    // Later samples from the same source are compared against this one, whether it is sent now or stored
+    reported->record = *record;
+    reported->valid = true;
+    reported->time = k_uptime_get();
+#endif
+
+    if (!ready)
+    {
+        mqttsnKeepRecord(record);
+        return;
+    }
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    if (mqttsnStorePending() > 0)
+    {
+        // Queue behind the backlog so samples reach the broker in order
+        mqttsnStoreLater(record);
+        mqttsnWorkSchedule(MQTTSN_WORK_DRAIN, &mqttsnDrainWork, 0);
+        return;
+    }
+#endif
+
+#if defined(CONFIG_MQTT_SNCLIENT_BATCH)
+    mqttsnBatchAdd(instance, record);
+#else
+    if (mqttsnPublishRecord(instance, record, record, NULL) == OT_ERROR_BUSY)
+    {
+        LOG_WRN("In-flight window full");
+        mqttsnKeepRecord(record);
+    }
+#endif
+}
+
+// Status and location streams both publish a full sample record
+static void mqttsnSampleStreamHandler(otInstance *instance)
+{
+    struct payloadRecord record;
+    bool ready = mqttsnPublishBegin(instance);
+
+    mqttsnBuildRecord(instance, &record);
+    mqttsnSampleSubmit(instance, ready, &record);
+}
+
+// Every fix received over Bluetooth since the last run goes through the sample pipeline
+static void mqttsnLocationStreamHandler(otInstance *instance)
+{
+    struct bt_lns_sample sample;
+
+    if (appbluetoothGetSample(&sample) != 0)
+    {
+        return;
+    }
+
+    bool ready = mqttsnPublishBegin(instance);
+
+    do
+    {
+        uint32_t age = (uint32_t)(k_uptime_get() - sample.timestamp);
+
+        _stats.fixes++;
+        _stats.fixAgeLastMs = age;
+        _stats.fixAgeMaxMs = MAX(_stats.fixAgeMaxMs, age);
+
+        if (!sample.data.location_present)
+        {
+            continue;
+        }
+
+        _fix = sample;
+        _fixValid = true;
+
+        struct payloadRecord record;
+        mqttsnBuildRecord(instance, &record);
+        mqttsnSampleSubmit(instance, ready, &record);
+    } while (appbluetoothGetSample(&sample) == 0);
+}
+
+static void mqttsnStatusStreamHandler(otInstance *instance)
+{
+    mqttsnSampleStreamHandler(instance);
+}
+
+// Client health, only sent while connected and never stored
+static void mqttsnDiagStreamHandler(otInstance *instance)
+{
+    struct payloadDiag diag;
+    uint8_t data[PAYLOAD_MAX_SIZE];
+
+    if (!mqttsnPublishBegin(instance))
+    {
+        return;
+    }
+
+    otExtAddress extAddress;
+    otLinkGetFactoryAssignedIeeeEui64(instance, &extAddress);
+
+    memcpy(diag.id, extAddress.m8, sizeof(diag.id));
+    diag.uptime = k_uptime_get() / MSEC_PER_SEC;
+    diag.published = _stats.published;
+    diag.failed = _stats.failed;
+    diag.retransmits = _stats.retransmits;
+    diag.searches = _stats.searches;
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    diag.stored = mqttsnStoreCount();
+#else
+    diag.stored = 0;
+#endif
+
+    int32_t length = payloadEncodeDiag(&diag, data, sizeof(data));
+    if (length < 0)
+    {
+        LOG_ERR("Diagnostics encoding failed");
+        return;
+    }
+
+    otError err = mqttsnPublishData(instance, data, length, NULL, 0, NULL);
+    LOG_DBG("Publishing diagnostics, %d bytes rsp %d", length, err);
+    LOG_INF("Publish cycles: last %u max %u", _stats.publishCyclesLast, _stats.publishCyclesMax);
+}
+
+static void mqttsnStreamWorkHandler(struct k_work *work)
+{
+    struct mqttsnStream *stream = CONTAINER_OF(work, struct mqttsnStream, work);
+    otInstance *instance = openthread_get_default_instance();
+
+    mqttsnWorkStarted(stream->item);
+
+    PERF_PROBE_BEGIN(PERF_MQTTSN_STREAM);
+    mqttsnApiLock();
+    stream->handler(instance);
+    mqttsnApiUnlock();
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    mqttsnStoreQueued();
+#endif
+    PERF_PROBE_END(PERF_MQTTSN_STREAM);
+
+    mqttsnIdle();
+}
+
+static void mqttsnStreamTimerHandler(struct k_timer *timer)
+{
+    struct mqttsnStream *stream = CONTAINER_OF(timer, struct mqttsnStream, timer);
+
+    coexThreadRequest();
+    mqttsnWorkSubmit(stream->item, &stream->work);
+}
+
+// FNV-1a over the EUI-64 and stream, spreads the fleet evenly over each period
+static uint32_t mqttsnStreamPhase(const otExtAddress *extAddress, const struct mqttsnStream *stream)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(extAddress->m8); i++)
+    {
+        hash = (hash ^ extAddress->m8[i]) * 16777619u;
+    }
+    hash = (hash ^ stream->item) * 16777619u;
+
+    return hash % stream->periodMs;
+}
+
+// Periodic timers keep absolute deadlines, the handler runtime does not add up
+static void mqttsnStreamStart(struct mqttsnStream *stream)
+{
+    if (stream->periodMs == 0)
+    {
+        k_timer_stop(&stream->timer);
+        LOG_INF("Stream %s disabled", stream->name);
+        return;
+    }
+
+    uint32_t phase = mqttsnStreamPhase(&_extAddress, stream);
+    LOG_INF("Stream %s every %u ms, phase %u ms", stream->name, stream->periodMs, phase);
+
+    k_timer_start(&stream->timer, K_MSEC(phase), K_MSEC(stream->periodMs));
+}
+
+static void mqttsnStreamsStart(otInstance *instance)
+{
+    otLinkGetFactoryAssignedIeeeEui64(instance, &_extAddress);
+
+    for (size_t i = 0; i < ARRAY_SIZE(_streams); i++)
+    {
+        struct mqttsnStream *stream = &_streams[i];
+
+        k_work_init(&stream->work, mqttsnStreamWorkHandler);
+        k_timer_init(&stream->timer, mqttsnStreamTimerHandler, NULL);
+        mqttsnStreamStart(stream);
+    }
+
+    _streamsStarted = true;
+}
+
+// Time until the next stream is due, the coexistence scheduler keeps the radio free for it
+uint32_t mqttsnNextDueMs(void)
+{
+    uint32_t next = UINT32_MAX;
+
+    if (!_streamsStarted)
+    {
+        return next;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(_streams); i++)
+    {
+        if (_streams[i].periodMs != 0)
+        {
+            next = MIN(next, k_timer_remaining_get(&_streams[i].timer));
+        }
+    }
+
+    return next;
+}
+
+// Shell and other runtime changes, the value is persisted once applied
+int mqttsnConfigSet(const char *name, const char *value)
+{
+    if (strcmp(name, MQTTSN_CONFIG_GATEWAY) == 0)
+    {
+        otIp6Address address;
+        if (strlen(value) >= sizeof(_gatewayAddress) ||
+            otIp6AddressFromString(value, &address) != OT_ERROR_NONE)
+        {
+            return -EINVAL;
+        }
+
+        k_mutex_lock(&_configLock, K_FOREVER);
+        strcpy(_gatewayAddress, value);
+        k_mutex_unlock(&_configLock);
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+        // The next connection starts with SEARCHGW to the new address
+        _gatewayCacheFailed = true;
+#endif
+
+        mqttsnConfigSave(name, value, strlen(value));
+        return 0;
+    }
+
+    const struct mqttsnParam *param = mqttsnParamFind(name);
+    if (param == NULL)
+    {
+        return -ENOENT;
+    }
+
+    char *end;
+    unsigned long parsed = strtoul(value, &end, 0);
+    if (*value == '\0' || *end != '\0' || parsed < param->min || parsed > param->max)
+    {
+        return -EINVAL;
+    }
+
+    uint32_t newValue = parsed;
+    *param->value = newValue;
+    if (param->stream != NULL && _streamsStarted)
+    {
+        mqttsnStreamStart(param->stream);
+    }
+
+    mqttsnConfigSave(name, &newValue, sizeof(newValue));
+    return 0;
+}
+
+// -ENOENT once index is past the last value
+int mqttsnConfigGet(size_t index, const char **name, char *value, size_t size)
+{
+    if (index < ARRAY_SIZE(_params))
+    {
+        *name = _params[index].name;
+        snprintk(value, size, "%u", *_params[index].value);
+        return 0;
+    }
+
+    if (index == ARRAY_SIZE(_params))
+    {
+        *name = MQTTSN_CONFIG_GATEWAY;
+        k_mutex_lock(&_configLock, K_FOREVER);
+        snprintk(value, size, "%s", _gatewayAddress);
+        k_mutex_unlock(&_configLock);
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
+// Back to the Kconfig values, stored values are removed
+int mqttsnConfigReset(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(_params); i++)
+    {
+        const struct mqttsnParam *param = &_params[i];
+        bool changed = *param->value != param->defaultValue;
+
+        *param->value = param->defaultValue;
+        if (changed && param->stream != NULL && _streamsStarted)
+        {
+            mqttsnStreamStart(param->stream);
+        }
+        mqttsnConfigSave(param->name, NULL, 0);
+    }
+
+    k_mutex_lock(&_configLock, K_FOREVER);
+    strcpy(_gatewayAddress, GATEWAY_MULTICAST_ADDRESS);
+    k_mutex_unlock(&_configLock);
+    mqttsnConfigSave(MQTTSN_CONFIG_GATEWAY, NULL, 0);
+
+    return 0;
+}
+
+// Started before anything can queue MQTT-SN work, role changes may arrive before mqttsnInit()
+static int mqttsnWorkQueueInit(void)
+{
+    const struct k_work_queue_config config = {
+        .name = "mqttsn",
+    };
+
+    k_work_queue_start(&mqttsnWorkQueue, mqttsnWorkQueueStack,
+        K_THREAD_STACK_SIZEOF(mqttsnWorkQueueStack), CONFIG_MQTT_SNCLIENT_WORKQ_PRIORITY, &config);
+
+    return 0;
+}
+
+SYS_INIT(mqttsnWorkQueueInit, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+otError mqttsnInit()
+{
+    otInstance *instance = openthread_get_default_instance();
+
+    mqttsnApiLock();
+    mqttsnInitIdentity(instance);
+    mqttsnApiUnlock();
+
+#if defined(CONFIG_SETTINGS)
+    // main() initialized the settings subsystem
+    settings_load_subtree("mqttsn/cfg");
+#endif
+#if defined(CONFIG_MQTT_SNCLIENT_GATEWAY_CACHE)
+    settings_load_subtree("mqttsn/gw");
+    if (_gatewayCacheValid)
+    {
+        LOG_INF("Cached gateway %d", _gatewayCache.gatewayId);
+    }
+#endif
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    mqttsnStoreInit();
+#endif
 
     // Start MQTT-SN client
     LOG_INF("Starting MQTT-SN on port %d", CLIENT_PORT);
+    mqttsnApiLock();
     otError error = otMqttsnStart(instance, CLIENT_PORT);
 
-    /* start one shot timer that expires after 10s */
     if(error == OT_ERROR_NONE)
-        k_timer_start(&mqttsnPublishTimer, K_SECONDS(10), K_NO_WAIT);
+        mqttsnStreamsStart(instance);
+    mqttsnApiUnlock();
+
+    // Thread may have attached while the client was starting
+    stateSubscribe(&_roleSubscriber);
+    if (error == OT_ERROR_NONE)
+    {
+        mqttsnRoleChanged(instance, OT_CHANGED_THREAD_ROLE);
+    }
 
     return error;
 }
\ No newline at end of file
@@ -19,11 +19,89 @@
 
 #define TOPIC_PREFIX CONFIG_MQTT_SNCLIENT_TOPIC_PREFIX
 
-#define PUBLISH_INTERVAL_MS CONFIG_MQTT_SNCLIENT_PUBLISH_INTERVAL_S
+#define PUBLISH_INTERVAL_MS CONFIG_MQTT_SNCLIENT_PUBLISH_INTERVAL_MS
+
+// Defaults of the runtime configuration, see mqttsnConfigSet()
+#define PUBLISH_QOS CONFIG_MQTT_SNCLIENT_QOS
+#define KEEPALIVE_S CONFIG_MQTT_SNCLIENT_KEEPALIVE_S
+#define RETRANSMISSION_COUNT CONFIG_MQTT_SNCLIENT_RETRANSMISSION_COUNT
+#define RETRANSMISSION_TIMEOUT_S CONFIG_MQTT_SNCLIENT_RETRANSMISSION_TIMEOUT_S
+#define ROLE_STABLE_MS CONFIG_MQTT_SNCLIENT_ROLE_STABLE_MS
+
+// Space left for the PUBLISH payload in one unfragmented 802.15.4 frame
+#define FRAME_PSDU_SIZE 127
+#define FRAME_MAC_OVERHEAD 27       // Header with extended source, aux security header, MIC-32 and FCS
+#define FRAME_MESH_OVERHEAD 5       // 6LoWPAN mesh header with short addresses
+#define FRAME_IP_OVERHEAD CONFIG_MQTT_SNCLIENT_FRAME_IP_OVERHEAD
+#define FRAME_UDP_OVERHEAD 7        // NHC UDP with inline ports and checksum
+#define MQTTSN_PUBLISH_OVERHEAD 7   // Length, type, flags, topic ID and message ID
+
+#define FRAME_PAYLOAD_SIZE (FRAME_PSDU_SIZE - FRAME_MAC_OVERHEAD - FRAME_MESH_OVERHEAD - \
+    FRAME_IP_OVERHEAD - FRAME_UDP_OVERHEAD - MQTTSN_PUBLISH_OVERHEAD)
+
+// Work items run on the MQTT-SN work queue
+enum mqttsnWorkItem
+{
+    MQTTSN_WORK_STATUS,     // Publication streams
+    MQTTSN_WORK_LOCATION,
+    MQTTSN_WORK_DIAG,
+    MQTTSN_WORK_DRAIN,
+    MQTTSN_WORK_BATCH,
+    MQTTSN_WORK_SLEEP,
+    MQTTSN_WORK_ROLE,       // Gateway check once the Thread role is stable
+    MQTTSN_WORK_COUNT,
+};
+
+struct mqttsnWorkStats
+{
+    uint32_t runs;
+    uint32_t delayLastUs;   // Time between due (timer expiry for streams) and start of the last run
+    uint32_t delayMaxUs;
+    uint64_t delayTotalUs;
+};
+
+struct mqttsnStats
+{
+    uint32_t searches;      // SEARCHGW multicasts sent
+    uint32_t roleFlaps;     // Role changes superseded by another one within the stable window
+    uint32_t searchesSuppressed;    // Stable roles that kept the existing gateway session
+    uint32_t probes;        // Echo requests sent to the gateway after a role change
+    uint32_t probesFailed;  // Probes left unanswered, each followed by a search
+    uint32_t cacheHits;     // Connections accepted by the cached gateway
+    uint32_t wakeCycles;    // Publish cycles woken from sleep
+    uint32_t wakeTimeLastMs;
+    uint32_t wakeTimeMaxMs;
+    uint32_t wakeTimeTotalMs;
+    uint32_t published;     // Publications acknowledged with PUBACK, or sent with QoS 0
+    uint32_t failed;        // Publications given up after all retransmits
+    uint32_t retransmits;
+    uint32_t timeouts;      // PUBACKs that never arrived
+    uint32_t pubackLatencyLastMs;
+    uint32_t pubackLatencyMaxMs;
+    uint32_t pubackLatencyTotalMs;
+    uint32_t publishRateMilli;  // Acknowledged messages per second x1000
+    uint32_t suppressed;    // Samples within all deadbands and not published
+    uint32_t fixes;         // Location values taken from the Bluetooth ring
+    uint32_t fixOverruns;   // Location values dropped because the ring was full
+    uint32_t fixAgeLastMs;  // Time a value waited in the ring
+    uint32_t fixAgeMaxMs;
+    uint32_t publishCyclesLast; // Encoding and sending one record, logging included
+    uint32_t publishCyclesMax;
+    uint32_t reconnects;    // Connections accepted after the first one
+    uint32_t txBytes;       // PUBLISH messages handed to UDP, retransmits included
+    uint32_t inFlight;      // Publications waiting for their PUBACK
+    struct mqttsnWorkStats work[MQTTSN_WORK_COUNT];
+};
 
 // Prototypes
 
 otError mqttsnInit(void);
 void mqttsnSearchGateway(otInstance *instance);
+void mqttsnSetSleepEnabled(bool enabled);
+void mqttsnGetStats(struct mqttsnStats *stats);
+int mqttsnConfigSet(const char *name, const char *value);
+int mqttsnConfigGet(size_t index, const char **name, char *value, size_t size);
+int mqttsnConfigReset(void);
+uint32_t mqttsnNextDueMs(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "mqttsn.h"
+
+// Includes
+
+#include <string.h>
+
+#include <zephyr/shell/shell.h>
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+#include "mqttsn_store.h"
+#endif
+
+// Definitions
+
+#define CONFIG_VALUE_SIZE 48
+
+// Functions
+
+static int mqttsnCmdGet(const struct shell *sh, size_t argc, char **argv)
+{
+    const char *name;
+    char value[CONFIG_VALUE_SIZE];
+
+    for (size_t i = 0; mqttsnConfigGet(i, &name, value, sizeof(value)) == 0; i++)
+    {
+        if (argc < 2 || strcmp(argv[1], name) == 0)
+        {
+            shell_print(sh, "%-26s %s", name, value);
+        }
+    }
+
+    return 0;
+}
+
+static int mqttsnCmdSet(const struct shell *sh, size_t argc, char **argv)
+{
+    int err = mqttsnConfigSet(argv[1], argv[2]);
+
+    if (err == -ENOENT)
+    {
+        shell_error(sh, "Unknown setting %s", argv[1]);
+    }
+    else if (err)
+    {
+        shell_error(sh, "Invalid value %s for %s", argv[2], argv[1]);
+    }
+    else
+    {
+        shell_print(sh, "Done");
+    }
+
+    return err;
+}
+
+static int mqttsnCmdReset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    int err = mqttsnConfigReset();
+    if (err == 0)
+    {
+        shell_print(sh, "Done");
+    }
+
+    return err;
+}
+
+static int mqttsnCmdStats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct mqttsnStats stats;
+    mqttsnGetStats(&stats);
+
+    shell_print(sh, "Published        %u (%u.%03u/s)", stats.published,
+        stats.publishRateMilli / 1000, stats.publishRateMilli % 1000);
+    shell_print(sh, "Failed           %u", stats.failed);
+    shell_print(sh, "Retransmits      %u", stats.retransmits);
+    shell_print(sh, "Timeouts         %u", stats.timeouts);
+    shell_print(sh, "In flight        %u", stats.inFlight);
+    shell_print(sh, "PUBACK latency   last %u ms, mean %u ms, max %u ms", stats.pubackLatencyLastMs,
+        stats.published ? stats.pubackLatencyTotalMs / stats.published : 0,
+        stats.pubackLatencyMaxMs);
+    shell_print(sh, "Sent             %u bytes", stats.txBytes);
+    shell_print(sh, "Reconnects       %u", stats.reconnects);
+    shell_print(sh, "Searches         %u (%u suppressed, %u role flaps)", stats.searches,
+        stats.searchesSuppressed, stats.roleFlaps);
+    shell_print(sh, "Gateway probes   %u (%u unanswered)", stats.probes, stats.probesFailed);
+    shell_print(sh, "Cache hits       %u", stats.cacheHits);
+    shell_print(sh, "Suppressed       %u", stats.suppressed);
+    shell_print(sh, "Fixes            %u (%u overruns)", stats.fixes, stats.fixOverruns);
+
+#if defined(CONFIG_MQTT_SNCLIENT_STORE)
+    struct mqttsnStoreStats store;
+    mqttsnStoreGetStats(&store);
+
+    shell_print(sh, "Stored           %u (queued %u, drained %u, dropped %u)", mqttsnStoreCount(),
+        store.queued, store.drained, store.dropped);
+#endif
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(mqttsnCmds,
+    SHELL_CMD_ARG(get, NULL, "Show settings [name]", mqttsnCmdGet, 1, 1),
+    SHELL_CMD_ARG(set, NULL, "Change and store a setting <name> <value>, applied to the next "
+        "publication, CONNECT or SEARCHGW", mqttsnCmdSet, 3, 0),
+    SHELL_CMD(reset, NULL, "Restore the default settings", mqttsnCmdReset),
+    SHELL_CMD(stats, NULL, "Client counters", mqttsnCmdStats),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(mqttsn, &mqttsnCmds, "MQTT-SN client", NULL);
@@ -0,0 +1,299 @@
+#include "mqttsn_store.h"
+
+// Includes
+
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+// Definitions
+
+// Each sample lives in its own settings key "mqttsn/q/<seq % capacity>", so an
+// append is a single NVS write and a drain a single delete. There is no head or
+// tail record to rewrite, which keeps flash wear proportional to the samples
+// stored. The queue bounds are recovered from the sequence numbers on boot.
+// A sample handed to the publisher stays stored until it is acknowledged.
+#define STORE_SUBTREE "mqttsn/q"
+#define STORE_CAPACITY CONFIG_MQTT_SNCLIENT_STORE_CAPACITY
+
+// Samples after the head that can be acknowledged out of order
+#define STORE_ACK_WINDOW 32
+
+struct storeEntry
+{
+    uint32_t seq;
+    struct payloadRecord record;
+};
+
+struct storeLoad
+{
+    struct storeEntry *entry;
+    bool found;
+};
+
+// Globals
+
+static K_MUTEX_DEFINE(_storeLock);
+static uint32_t _head;  // Sequence number of the oldest stored sample
+static uint32_t _tail;  // Sequence number of the next sample to store
+static uint32_t _next;  // Sequence number of the next sample to publish
+static uint32_t _acked; // Bit n set once sample _head + n is acknowledged
+static struct mqttsnStoreStats _stats;
+
+LOG_MODULE_REGISTER(mqttsn_store, CONFIG_MQTT_SNCLIENT_LOG_LEVEL);
+
+// Support functions
+
+static void storeKey(char *key, size_t size, uint32_t seq)
+{
+    snprintf(key, size, STORE_SUBTREE "/%u", seq % STORE_CAPACITY);
+}
+
+static int storeSettingsSet(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    struct storeEntry entry;
+
+    if (len != sizeof(entry))
+    {
+        return 0;
+    }
+
+    if (read_cb(cb_arg, &entry, sizeof(entry)) != sizeof(entry))
+    {
+        return 0;
+    }
+
+    if (_head == _tail)
+    {
+        _head = entry.seq;
+        _tail = entry.seq + 1;
+    }
+    else
+    {
+        if ((int32_t)(entry.seq - _head) < 0)
+            _head = entry.seq;
+        if ((int32_t)(entry.seq + 1 - _tail) > 0)
+            _tail = entry.seq + 1;
+    }
+
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(mqttsn_store, STORE_SUBTREE, NULL, storeSettingsSet, NULL, NULL);
+
+static int storeLoadDirect(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg, void *param)
+{
+    struct storeLoad *load = param;
+
+    // Only the exact key is of interest, not any child nodes
+    if (key != NULL)
+    {
+        return 0;
+    }
+
+    if (len == sizeof(*load->entry) &&
+        read_cb(cb_arg, load->entry, sizeof(*load->entry)) == sizeof(*load->entry))
+    {
+        load->found = true;
+    }
+
+    return 0;
+}
+
+// Move the head over acknowledged samples, called with the lock held
+static void storeAdvance(void)
+{
+    while (_head != _next && (_acked & 1))
+    {
+        _head++;
+        _acked >>= 1;
+    }
+
+    if (_head == _tail)
+    {
+        // Empty - restart numbering so keys stay within the capacity window
+        _head = _tail = _next = 0;
+        _acked = 0;
+    }
+}
+
+// Functions
+
+int mqttsnStoreInit(void)
+{
+    k_mutex_lock(&_storeLock, K_FOREVER);
+    int err = settings_load_subtree(STORE_SUBTREE);
+    if (_tail - _head > STORE_CAPACITY)
+    {
+        // Gaps left by an interrupted drain, keep the most recent window
+        _head = _tail - STORE_CAPACITY;
+    }
+    _next = _head;
+    k_mutex_unlock(&_storeLock);
+
+    LOG_INF("Store holds %u samples", _tail - _head);
+
+    return err;
+}
+
+int mqttsnStorePush(const struct payloadRecord *record)
+{
+    char key[SETTINGS_MAX_NAME_LEN];
+    struct storeEntry entry;
+
+    k_mutex_lock(&_storeLock, K_FOREVER);
+
+    // Full - the key of the oldest sample is reused below
+    bool full = (_tail - _head >= STORE_CAPACITY);
+
+    entry.seq = _tail;
+    memcpy(&entry.record, record, sizeof(entry.record));
+    storeKey(key, sizeof(key), entry.seq);
+
+    int err = settings_save_one(key, &entry, sizeof(entry));
+    if (err)
+    {
+        LOG_WRN("Store write failed (err %d)", err);
+    }
+    else
+    {
+        // The oldest sample is only gone once it has been overwritten
+        if (full)
+        {
+            _head++;
+            _acked >>= 1;
+            _stats.dropped++;
+            if ((int32_t)(_next - _head) < 0)
+            {
+                _next = _head;
+            }
+        }
+        _tail++;
+        _stats.queued++;
+    }
+
+    k_mutex_unlock(&_storeLock);
+
+    return err;
+}
+
+// Next sample to publish, -EBUSY while too many after the head are unacknowledged
+int mqttsnStorePeek(struct payloadRecord *record, uint32_t *seq)
+{
+    char key[SETTINGS_MAX_NAME_LEN];
+    struct storeEntry entry;
+    struct storeLoad load = { .entry = &entry };
+    int err = 0;
+
+    k_mutex_lock(&_storeLock, K_FOREVER);
+
+    while (_next != _tail)
+    {
+        uint32_t offset = _next - _head;
+        if (offset >= STORE_ACK_WINDOW)
+        {
+            err = -EBUSY;
+            break;
+        }
+
+        // Acknowledged before a rewind
+        if (_acked & BIT(offset))
+        {
+            _next++;
+            continue;
+        }
+
+        storeKey(key, sizeof(key), _next);
+        load.found = false;
+        err = settings_load_subtree_direct(key, storeLoadDirect, &load);
+        if (err)
+        {
+            break;
+        }
+        if (load.found && entry.seq == _next)
+        {
+            memcpy(record, &entry.record, sizeof(*record));
+            *seq = _next;
+            break;
+        }
+
+        // Slot gone missing, skip it like an acknowledged one
+        _acked |= BIT(offset);
+        _next++;
+    }
+
+    if (!err && _next == _tail)
+    {
+        err = -ENOENT;
+    }
+
+    storeAdvance();
+
+    k_mutex_unlock(&_storeLock);
+
+    return err;
+}
+
+// The sample returned by mqttsnStorePeek() is being published
+void mqttsnStoreSent(uint32_t seq)
+{
+    k_mutex_lock(&_storeLock, K_FOREVER);
+    if (seq == _next)
+    {
+        _next++;
+    }
+    k_mutex_unlock(&_storeLock);
+}
+
+// The sample was acknowledged, or can never be published, and is deleted
+int mqttsnStoreAck(uint32_t seq)
+{
+    char key[SETTINGS_MAX_NAME_LEN];
+
+    k_mutex_lock(&_storeLock, K_FOREVER);
+
+    // Overwritten while in flight, the key now holds a newer sample
+    if ((int32_t)(seq - _head) < 0 || (int32_t)(seq - _next) >= 0)
+    {
+        k_mutex_unlock(&_storeLock);
+        return -ENOENT;
+    }
+
+    storeKey(key, sizeof(key), seq);
+    int err = settings_delete(key);
+    if (err)
+    {
+        LOG_WRN("Store delete failed (err %d)", err);
+    }
+
+    _acked |= BIT(seq - _head);
+    _stats.drained++;
+    storeAdvance();
+
+    k_mutex_unlock(&_storeLock);
+
+    return err;
+}
+
+// Publish again from the oldest unacknowledged sample
+void mqttsnStoreRewind(void)
+{
+    k_mutex_lock(&_storeLock, K_FOREVER);
+    _next = _head;
+    k_mutex_unlock(&_storeLock);
+}
+
+uint32_t mqttsnStoreCount(void)
+{
+    return _tail - _head;
+}
+
+void mqttsnStoreGetStats(struct mqttsnStoreStats *stats)
+{
+    k_mutex_lock(&_storeLock, K_FOREVER);
+    memcpy(stats, &_stats, sizeof(*stats));
+    k_mutex_unlock(&_storeLock);
+}
@@ -0,0 +1,31 @@
+#ifndef MQTTSN_STORE_H_
+#define MQTTSN_STORE_H_
+
+// Includes
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "payload.h"
+
+// Definitions
+
+struct mqttsnStoreStats
+{
+    uint32_t queued;    // Samples appended while offline
+    uint32_t drained;   // Stored samples acknowledged by the gateway
+    uint32_t dropped;   // Oldest samples overwritten when full
+};
+
+// Prototypes
+
+int mqttsnStoreInit(void);
+int mqttsnStorePush(const struct payloadRecord *record);
+int mqttsnStorePeek(struct payloadRecord *record, uint32_t *seq);
+void mqttsnStoreSent(uint32_t seq);
+int mqttsnStoreAck(uint32_t seq);
+void mqttsnStoreRewind(void);
+uint32_t mqttsnStoreCount(void);
+void mqttsnStoreGetStats(struct mqttsnStoreStats *stats);
+
+#endif
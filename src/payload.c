@@ -0,0 +1,361 @@
+#include "payload.h"
+
+// Includes
+
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+// Definitions
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NINT 1
+#define CBOR_MAJOR_BSTR 2
+#define CBOR_MAJOR_TSTR 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_NULL 0xF6
+
+enum payloadType
+{
+    PAYLOAD_TYPE_BSTR8,
+    PAYLOAD_TYPE_ADDR,
+    PAYLOAD_TYPE_TSTR,
+    PAYLOAD_TYPE_U8,
+    PAYLOAD_TYPE_U32,
+    PAYLOAD_TYPE_I16,
+    PAYLOAD_TYPE_I32,
+};
+
+struct payloadField
+{
+    uint8_t key;
+    uint8_t type;
+    uint16_t offset;
+};
+
+struct cborWriter
+{
+    uint8_t *buf;
+    size_t size;
+    size_t pos;
+    bool overflow;
+};
+
+// Globals
+
+// Record schema - keys must stay in sync with the host decoder
+static const struct payloadField _fields[] = {
+    { PAYLOAD_KEY_ID,     PAYLOAD_TYPE_BSTR8, offsetof(struct payloadRecord, id) },
+    { PAYLOAD_KEY_COUNT,  PAYLOAD_TYPE_U32,   offsetof(struct payloadRecord, count) },
+    { PAYLOAD_KEY_STATUS, PAYLOAD_TYPE_TSTR,  offsetof(struct payloadRecord, status) },
+    { PAYLOAD_KEY_BATT,   PAYLOAD_TYPE_U8,    offsetof(struct payloadRecord, battery) },
+    { PAYLOAD_KEY_LAT,    PAYLOAD_TYPE_I32,   offsetof(struct payloadRecord, latitude) },
+    { PAYLOAD_KEY_LON,    PAYLOAD_TYPE_I32,   offsetof(struct payloadRecord, longitude) },
+    { PAYLOAD_KEY_ELE,    PAYLOAD_TYPE_I32,   offsetof(struct payloadRecord, elevation) },
+    { PAYLOAD_KEY_TEMP,   PAYLOAD_TYPE_I16,   offsetof(struct payloadRecord, temperature) },
+    { PAYLOAD_KEY_PEER,   PAYLOAD_TYPE_ADDR,  offsetof(struct payloadRecord, peer) },
+};
+
+// Support functions
+
+static void cborPut(struct cborWriter *w, const uint8_t *data, size_t len)
+{
+    if (w->overflow || w->size - w->pos < len)
+    {
+        w->overflow = true;
+        return;
+    }
+    memcpy(&w->buf[w->pos], data, len);
+    w->pos += len;
+}
+
+static void cborHead(struct cborWriter *w, uint8_t major, uint64_t value)
+{
+    uint8_t head[9];
+    size_t len;
+
+    major <<= 5;
+    if (value < 24)
+    {
+        head[0] = major | value;
+        len = 1;
+    }
+    else if (value <= UINT8_MAX)
+    {
+        head[0] = major | 24;
+        len = 2;
+    }
+    else if (value <= UINT16_MAX)
+    {
+        head[0] = major | 25;
+        len = 3;
+    }
+    else if (value <= UINT32_MAX)
+    {
+        head[0] = major | 26;
+        len = 5;
+    }
+    else
+    {
+        head[0] = major | 27;
+        len = 9;
+    }
+
+    // Big endian argument follows the initial byte
+    for (size_t i = len - 1; i > 0; i--)
+    {
+        head[i] = value;
+        value >>= 8;
+    }
+    cborPut(w, head, len);
+}
+
+static void cborInt(struct cborWriter *w, int64_t value)
+{
+    if (value >= 0)
+        cborHead(w, CBOR_MAJOR_UINT, (uint64_t)value);
+    else
+        cborHead(w, CBOR_MAJOR_NINT, (uint64_t)(-1 - value));
+}
+
+static int64_t payloadFieldValue(const struct payloadField *field, const struct payloadRecord *record)
+{
+    const uint8_t *value = (const uint8_t *)record + field->offset;
+
+    switch (field->type)
+    {
+        case PAYLOAD_TYPE_U8:
+            return *value;
+        case PAYLOAD_TYPE_U32:
+            return *(const uint32_t *)value;
+        case PAYLOAD_TYPE_I16:
+            return *(const int16_t *)value;
+        case PAYLOAD_TYPE_I32:
+            return *(const int32_t *)value;
+        default:
+            return 0;
+    }
+}
+
+// Encode one field, numbers as a delta and repeated strings as null when prev is given
+static void cborField(struct cborWriter *w, const struct payloadField *field,
+    const struct payloadRecord *record, const struct payloadRecord *prev)
+{
+    const uint8_t *value = (const uint8_t *)record + field->offset;
+
+    switch (field->type)
+    {
+        case PAYLOAD_TYPE_BSTR8:
+            cborHead(w, CBOR_MAJOR_BSTR, 8);
+            cborPut(w, value, 8);
+            break;
+        case PAYLOAD_TYPE_ADDR:
+        {
+            // Repeated as null like the status, no address as an empty string
+            static const uint8_t none[sizeof(record->peer)];
+            size_t len = memcmp(value, none, sizeof(record->peer)) ? sizeof(record->peer) : 0;
+            if (prev && memcmp(record->peer, prev->peer, sizeof(record->peer)) == 0)
+            {
+                uint8_t null = CBOR_NULL;
+                cborPut(w, &null, 1);
+                break;
+            }
+            cborHead(w, CBOR_MAJOR_BSTR, len);
+            cborPut(w, value, len);
+            break;
+        }
+        case PAYLOAD_TYPE_TSTR:
+        {
+            size_t len = strnlen((const char *)value, sizeof(record->status));
+            if (prev && strncmp(record->status, prev->status, sizeof(record->status)) == 0)
+            {
+                uint8_t null = CBOR_NULL;
+                cborPut(w, &null, 1);
+                break;
+            }
+            cborHead(w, CBOR_MAJOR_TSTR, len);
+            cborPut(w, value, len);
+            break;
+        }
+        default:
+        {
+            int64_t number = payloadFieldValue(field, record);
+            if (prev)
+                number -= payloadFieldValue(field, prev);
+            cborInt(w, number);
+            break;
+        }
+    }
+}
+
+// Functions
+
+int payloadEncodeCbor(const struct payloadRecord *record, uint8_t *buf, size_t size)
+{
+    struct cborWriter w = { .buf = buf, .size = size };
+
+    cborHead(&w, CBOR_MAJOR_MAP, ARRAY_SIZE(_fields));
+
+    for (size_t i = 0; i < ARRAY_SIZE(_fields); i++)
+    {
+        cborHead(&w, CBOR_MAJOR_UINT, _fields[i].key);
+        cborField(&w, &_fields[i], record, NULL);
+    }
+
+    return w.overflow ? -1 : (int)w.pos;
+}
+
+int payloadEncodeJson(const struct payloadRecord *record, uint8_t *buf, size_t size)
+{
+    // Compact so the largest record still fits PAYLOAD_MAX_SIZE
+    const char* strdata = "{\"id\":\"%02x%02x%02x%02x%02x%02x%02x%02x\",\"count\":%u,\"status\":\"%.4s\",\"batt\":%d,\"lat\":%d,\"lon\":%d,\"ele\":%d,\"temp\":%s%d.%02d,\"peer\":\"%02x%02x%02x%02x%02x%02x\"}";
+
+    int len = snprintf((char *)buf, size, strdata,
+        record->id[0],
+        record->id[1],
+        record->id[2],
+        record->id[3],
+        record->id[4],
+        record->id[5],
+        record->id[6],
+        record->id[7],
+        (unsigned int)record->count,
+        record->status,
+        record->battery,
+        (int)record->latitude,
+        (int)record->longitude,
+        (int)record->elevation,
+        record->temperature < 0 ? "-" : "",
+        ABS(record->temperature) / 100,
+        ABS(record->temperature) % 100,
+        record->peer[5],
+        record->peer[4],
+        record->peer[3],
+        record->peer[2],
+        record->peer[1],
+        record->peer[0]);
+
+    if (len < 0 || (size_t)len >= size)
+        return -1;
+
+    return len;
+}
+
+int payloadEncode(const struct payloadRecord *record, uint8_t *buf, size_t size)
+{
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_CBOR)
+    return payloadEncodeCbor(record, buf, size);
+#else
+    return payloadEncodeJson(record, buf, size);
+#endif
+}
+
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_CBOR)
+// A batch is { id: bstr, records: [[count, status, ...], ...] } - the device ID
+// is sent once and records are positional arrays in schema order without keys.
+// Records after the first carry numbers as deltas to the previous record and an
+// unchanged status as null, which usually packs them into a handful of bytes.
+static int payloadEncodeBatchCbor(const struct payloadRecord *records, size_t count,
+    uint8_t *buf, size_t size)
+{
+    struct cborWriter w = { .buf = buf, .size = size };
+
+    cborHead(&w, CBOR_MAJOR_MAP, 2);
+    cborHead(&w, CBOR_MAJOR_UINT, PAYLOAD_KEY_ID);
+    cborField(&w, &_fields[0], &records[0], NULL);
+    cborHead(&w, CBOR_MAJOR_UINT, PAYLOAD_KEY_RECORDS);
+    cborHead(&w, CBOR_MAJOR_ARRAY, count);
+
+    for (size_t r = 0; r < count; r++)
+    {
+        cborHead(&w, CBOR_MAJOR_ARRAY, ARRAY_SIZE(_fields) - 1);
+        for (size_t i = 1; i < ARRAY_SIZE(_fields); i++)
+        {
+            cborField(&w, &_fields[i], &records[r], (r > 0) ? &records[r - 1] : NULL);
+        }
+    }
+
+    return w.overflow ? -1 : (int)w.pos;
+}
+
+#else
+static int payloadEncodeBatchJson(const struct payloadRecord *records, size_t count,
+    uint8_t *buf, size_t size)
+{
+    size_t pos = 0;
+
+    for (size_t r = 0; r < count; r++)
+    {
+        // Opening bracket or separator, the closing bracket is reserved below
+        if (size - pos < 2)
+            return -1;
+        buf[pos++] = (r == 0) ? '[' : ',';
+
+        int len = payloadEncodeJson(&records[r], &buf[pos], size - pos - 1);
+        if (len < 0)
+            return -1;
+        pos += len;
+    }
+
+    if (pos >= size)
+        return -1;
+    buf[pos++] = ']';
+
+    return pos;
+}
+#endif
+
+int payloadEncodeBatch(const struct payloadRecord *records, size_t count, uint8_t *buf, size_t size)
+{
+    if (count == 0 || count > PAYLOAD_BATCH_MAX)
+        return -1;
+
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_CBOR)
+    return payloadEncodeBatchCbor(records, count, buf, size);
+#else
+    return payloadEncodeBatchJson(records, count, buf, size);
+#endif
+}
+
+// Diagnostics are { id: bstr, diag: [uptime, published, failed, retransmits, searches, stored] }
+int payloadEncodeDiag(const struct payloadDiag *diag, uint8_t *buf, size_t size)
+{
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_CBOR)
+    struct cborWriter w = { .buf = buf, .size = size };
+    const uint32_t values[] = {
+        diag->uptime, diag->published, diag->failed, diag->retransmits, diag->searches, diag->stored,
+    };
+
+    cborHead(&w, CBOR_MAJOR_MAP, 2);
+    cborHead(&w, CBOR_MAJOR_UINT, PAYLOAD_KEY_ID);
+    cborHead(&w, CBOR_MAJOR_BSTR, sizeof(diag->id));
+    cborPut(&w, diag->id, sizeof(diag->id));
+    cborHead(&w, CBOR_MAJOR_UINT, PAYLOAD_KEY_DIAG);
+    cborHead(&w, CBOR_MAJOR_ARRAY, ARRAY_SIZE(values));
+    for (size_t i = 0; i < ARRAY_SIZE(values); i++)
+    {
+        cborHead(&w, CBOR_MAJOR_UINT, values[i]);
+    }
+
+    return w.overflow ? -1 : (int)w.pos;
+#else
+    const char* strdata = "{\"id\":\"%02x%02x%02x%02x%02x%02x%02x%02x\",\"uptime\":%u,\"published\":%u,\"failed\":%u,\"retransmits\":%u,\"searches\":%u,\"stored\":%u}";
+
+    int len = snprintf((char *)buf, size, strdata,
+        diag->id[0], diag->id[1], diag->id[2], diag->id[3],
+        diag->id[4], diag->id[5], diag->id[6], diag->id[7],
+        (unsigned int)diag->uptime,
+        (unsigned int)diag->published,
+        (unsigned int)diag->failed,
+        (unsigned int)diag->retransmits,
+        (unsigned int)diag->searches,
+        (unsigned int)diag->stored);
+
+    if (len < 0 || (size_t)len >= size)
+        return -1;
+
+    return len;
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef PAYLOAD_H_
+#define PAYLOAD_H_
+
+// Includes
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Definitions
+
+// Largest encoded record for either payload format
+#define PAYLOAD_MAX_SIZE 160
+
+// Map keys used by the CBOR encoding (see scripts/payload_decode.py)
+enum payloadKey
+{
+    PAYLOAD_KEY_ID = 0,
+    PAYLOAD_KEY_COUNT = 1,
+    PAYLOAD_KEY_STATUS = 2,
+    PAYLOAD_KEY_BATT = 3,
+    PAYLOAD_KEY_LAT = 4,
+    PAYLOAD_KEY_LON = 5,
+    PAYLOAD_KEY_ELE = 6,
+    PAYLOAD_KEY_TEMP = 7,
+    PAYLOAD_KEY_RECORDS = 8,
+    PAYLOAD_KEY_DIAG = 9,
+    PAYLOAD_KEY_PEER = 10,
+};
+
+// Most records in one batch, keeps the CBOR array header to a single byte
+#define PAYLOAD_BATCH_MAX 23
+
+struct payloadRecord
+{
+    uint8_t id[8];          // Factory EUI-64
+    uint32_t count;         // Sample sequence number
+    char status[4];         // Triage state e.g. "P1"
+    uint8_t battery;        // Battery level (percent)
+    int32_t latitude;       // Latitude (10e-7 degrees)
+    int32_t longitude;      // Longitude (10e-7 degrees)
+    int32_t elevation;      // Elevation (1/100 meters)
+    int16_t temperature;    // Temperature (1/100 degrees C)
+    uint8_t peer[6];        // Bluetooth address of the location source, zero for none
+};
+
+// Client health counters published by the diagnostics stream
+struct payloadDiag
+{
+    uint8_t id[8];          // Factory EUI-64
+    uint32_t uptime;        // Seconds since boot
+    uint32_t published;     // Acknowledged publications
+    uint32_t failed;        // Publications given up
+    uint32_t retransmits;
+    uint32_t searches;      // SEARCHGW multicasts sent
+    uint32_t stored;        // Samples waiting in flash
+};
+
+// Prototypes
+
+int payloadEncodeCbor(const struct payloadRecord *record, uint8_t *buf, size_t size);
+int payloadEncodeJson(const struct payloadRecord *record, uint8_t *buf, size_t size);
+int payloadEncode(const struct payloadRecord *record, uint8_t *buf, size_t size);
+int payloadEncodeBatch(const struct payloadRecord *records, size_t count, uint8_t *buf, size_t size);
+int payloadEncodeDiag(const struct payloadDiag *diag, uint8_t *buf, size_t size);
+
+#endif
@@ -0,0 +1,199 @@
+#include "perf.h"
+
+// Includes
+
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+// Definitions
+
+LOG_MODULE_REGISTER(perf, CONFIG_APP_PERF_LOG_LEVEL);
+
+#if defined(PERF_USE_DWT)
+#define PERF_CYCLES_PER_SEC DT_PROP(DT_PATH(cpus, cpu_0), clock_frequency)
+#else
+#define PERF_CYCLES_PER_SEC sys_clock_hw_cycles_per_sec()
+#endif
+
+// Globals
+
+static const char *const perfProbeNames[PERF_PROBE_COUNT] = {
+    [PERF_LNS_NOTIFY] = "lns_notify",
+    [PERF_MQTTSN_STREAM] = "mqttsn_stream",
+    [PERF_MQTTSN_PUBLISH] = "mqttsn_publish",
+    [PERF_OT_STATE_CHANGED] = "ot_state_changed",
+};
+
+static struct perfHistogram _histograms[PERF_PROBE_COUNT];
+static struct k_spinlock _lock;
+
+// Functions
+
+void perfRecord(enum perfProbe probe, uint32_t cycles)
+{
+    struct perfHistogram *histogram = &_histograms[probe];
+    uint32_t bucket = cycles ? 32 - __builtin_clz(cycles) : 0;
+
+    k_spinlock_key_t key = k_spin_lock(&_lock);
+
+    if (histogram->count == 0 || cycles < histogram->min)
+    {
+        histogram->min = cycles;
+    }
+    histogram->max = MAX(histogram->max, cycles);
+    histogram->count++;
+    histogram->total += cycles;
+    histogram->buckets[bucket]++;
+
+    k_spin_unlock(&_lock, key);
+}
+
+void perfGet(enum perfProbe probe, struct perfHistogram *histogram)
+{
+    k_spinlock_key_t key = k_spin_lock(&_lock);
+    *histogram = _histograms[probe];
+    k_spin_unlock(&_lock, key);
+}
+
+void perfReset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&_lock);
+    memset(_histograms, 0, sizeof(_histograms));
+    k_spin_unlock(&_lock, key);
+}
+
+// Upper bound of the bucket holding the percentile, never above the largest sample
+static uint32_t perfPercentile(const struct perfHistogram *histogram, uint32_t percent)
+{
+    uint64_t rank = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for (int i = 0; i < PERF_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            uint32_t bound = i == 0 ? 0 : (uint32_t)((1ULL << i) - 1);
+            return MIN(bound, histogram->max);
+        }
+    }
+
+    return histogram->max;
+}
+
+static uint32_t perfCyclesToNs(uint64_t cycles)
+{
+    return (uint32_t)MIN(cycles * 1000000000ULL / PERF_CYCLES_PER_SEC, UINT32_MAX);
+}
+
+static int perfFindProbe(const char *name)
+{
+    for (int i = 0; i < PERF_PROBE_COUNT; i++)
+    {
+        if (strcmp(name, perfProbeNames[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int perfCmdShow(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    shell_print(sh, "Cycles at %u Hz", (uint32_t)PERF_CYCLES_PER_SEC);
+    shell_print(sh, "%-18s %8s %10s %10s %10s %10s %10s %10s %10s", "probe", "count",
+        "min", "mean", "p50", "p90", "p99", "max", "max ns");
+
+    for (int i = 0; i < PERF_PROBE_COUNT; i++)
+    {
+        struct perfHistogram histogram;
+
+        perfGet(i, &histogram);
+        if (histogram.count == 0)
+        {
+            shell_print(sh, "%-18s %8u", perfProbeNames[i], 0);
+            continue;
+        }
+
+        shell_print(sh, "%-18s %8u %10u %10u %10u %10u %10u %10u %10u", perfProbeNames[i],
+            histogram.count, histogram.min, (uint32_t)(histogram.total / histogram.count),
+            perfPercentile(&histogram, 50), perfPercentile(&histogram, 90),
+            perfPercentile(&histogram, 99), histogram.max, perfCyclesToNs(histogram.max));
+    }
+
+    return 0;
+}
+
+static int perfCmdHist(const struct shell *sh, size_t argc, char **argv)
+{
+    int probe = perfFindProbe(argv[1]);
+    if (probe < 0)
+    {
+        shell_error(sh, "Unknown probe %s", argv[1]);
+        return -EINVAL;
+    }
+
+    struct perfHistogram histogram;
+    perfGet(probe, &histogram);
+
+    shell_print(sh, "%-26s%10s", "cycles", "count");
+    for (int i = 0; i < PERF_BUCKETS; i++)
+    {
+        if (histogram.buckets[i] == 0)
+        {
+            continue;
+        }
+
+        uint32_t low = i == 0 ? 0 : (uint32_t)(1ULL << (i - 1));
+        uint32_t high = i == 0 ? 0 : (uint32_t)((1ULL << i) - 1);
+        shell_print(sh, "%10u - %-10u   %10u", low, high, histogram.buckets[i]);
+    }
+
+    return 0;
+}
+
+static int perfCmdReset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    perfReset();
+    shell_print(sh, "Done");
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(perfCmds,
+    SHELL_CMD(show, NULL, "Summary of all probes", perfCmdShow),
+    SHELL_CMD_ARG(hist, NULL, "Histogram of one probe <name>", perfCmdHist, 2, 0),
+    SHELL_CMD(reset, NULL, "Clear all probes", perfCmdReset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(perf, &perfCmds, "Hot path latency histograms", perfCmdShow);
+
+static int perfInit(void)
+{
+#if defined(PERF_USE_DWT)
+    int err = z_arm_dwt_init();
+    if (err)
+    {
+        LOG_ERR("Cycle counter not available (err %d)", err);
+        return err;
+    }
+    z_arm_dwt_cycle_count_start();
+#endif
+
+    return 0;
+}
+
+// Before main, so the probes in the OpenThread setup are covered
+SYS_INIT(perfInit, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,67 @@
+#ifndef PERF_H_
+#define PERF_H_
+
+// Includes
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#if defined(CONFIG_CORTEX_M_DWT) && defined(CONFIG_ARMV7_M_ARMV8_M_MAINLINE)
+#include <zephyr/arch/arm/aarch32/cortex_m/dwt.h>
+#define PERF_USE_DWT 1
+#endif
+
+// Definitions
+
+// Probes placed around the hot paths, see perfProbeNames in perf.c
+enum perfProbe
+{
+    PERF_LNS_NOTIFY,        // Decoding a notification into the sample ring
+    PERF_MQTTSN_STREAM,     // One run of a publication stream
+    PERF_MQTTSN_PUBLISH,    // Encoding and sending one record
+    PERF_OT_STATE_CHANGED,
+    PERF_PROBE_COUNT,
+};
+
+// Bucket 0 counts zero cycles, bucket n counts [2^(n-1), 2^n)
+#define PERF_BUCKETS 33
+
+struct perfHistogram
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[PERF_BUCKETS];
+};
+
+#if defined(CONFIG_APP_PERF)
+
+static inline uint32_t perfCycles(void)
+{
+#if defined(PERF_USE_DWT)
+    return z_arm_dwt_get_cycles();
+#else
+    return k_cycle_get_32();
+#endif
+}
+
+// Open and close a probe in the same scope and leave it through the END, a return in between loses the sample
+#define PERF_PROBE_BEGIN(probe) uint32_t perfStart_##probe = perfCycles()
+#define PERF_PROBE_END(probe) perfRecord(probe, perfCycles() - perfStart_##probe)
+
+// Prototypes
+
+void perfRecord(enum perfProbe probe, uint32_t cycles);
+void perfGet(enum perfProbe probe, struct perfHistogram *histogram);
+void perfReset(void);
+
+#else
+
+#define PERF_PROBE_BEGIN(probe)
+#define PERF_PROBE_END(probe)
+
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+#include "state.h"
+
+// Includes
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/shell/shell.h>
+
+#include "perf.h"
+
+// Definitions
+
+LOG_MODULE_REGISTER(state, CONFIG_OT_COMMAND_LINE_INTERFACE_LOG_LEVEL);
+
+// Protototypes
+
+static void stateWorkHandler(struct k_work *work);
+
+// Globals
+
+static const char *const stateFlagNames[32] = {
+    [0] = "ip6_address_added",
+    [1] = "ip6_address_removed",
+    [2] = "role",
+    [3] = "ll_addr",
+    [4] = "ml_addr",
+    [5] = "rloc_added",
+    [6] = "rloc_removed",
+    [7] = "partition_id",
+    [8] = "key_sequence",
+    [9] = "netdata",
+    [10] = "child_added",
+    [11] = "child_removed",
+    [12] = "ip6_mcast_subscribed",
+    [13] = "ip6_mcast_unsubscribed",
+    [14] = "channel",
+    [15] = "panid",
+    [16] = "network_name",
+    [17] = "ext_panid",
+    [18] = "network_key",
+    [19] = "pskc",
+    [20] = "security_policy",
+    [21] = "channel_manager",
+    [22] = "channel_mask",
+    [23] = "commissioner",
+    [24] = "netif_state",
+    [25] = "bbr_state",
+    [26] = "bbr_local",
+    [27] = "joiner",
+    [28] = "active_dataset",
+    [29] = "pending_dataset",
+    [30] = "nat64",
+    [31] = "parent_link_quality",
+};
+
+BUILD_ASSERT(OT_CHANGED_THREAD_ROLE == BIT(2) && OT_CHANGED_THREAD_NETDATA == BIT(9) &&
+    OT_CHANGED_ACTIVE_DATASET == BIT(28), "stateFlagNames does not match the OT_CHANGED_* bits");
+
+static otInstance *_instance;
+static K_WORK_DEFINE(stateWork, stateWorkHandler);
+static atomic_t _pending;
+static sys_slist_t _subscribers = SYS_SLIST_STATIC_INIT(&_subscribers);
+static K_MUTEX_DEFINE(_subscribersLock);
+static struct stateStats _stats;
+
+// Functions
+
+// Runs in the OpenThread thread, only collects the flags. Bursts of changes,
+// e.g. an attach raising role, addresses and netdata in several callbacks,
+// end up in one run of the work item.
+static void stateChanged(otChangedFlags aFlags, void *aContext)
+{
+    ARG_UNUSED(aContext);
+
+    _stats.callbacks++;
+    for (otChangedFlags flags = aFlags; flags; flags &= flags - 1)
+    {
+        _stats.flags[__builtin_ctz(flags)]++;
+    }
+
+    atomic_or(&_pending, aFlags);
+    k_work_submit(&stateWork);
+}
+
+static void stateWorkHandler(struct k_work *work)
+{
+    otChangedFlags flags = (otChangedFlags)atomic_clear(&_pending);
+    struct stateSubscriber *subscriber;
+
+    if (flags == 0)
+    {
+        return;
+    }
+
+    PERF_PROBE_BEGIN(PERF_OT_STATE_CHANGED);
+
+    _stats.dispatches++;
+    for (otChangedFlags bits = flags; bits; bits &= bits - 1)
+    {
+        LOG_DBG("State changed: %s", stateFlagNames[__builtin_ctz(bits)]);
+    }
+
+    openthread_api_mutex_lock(openthread_get_default_context());
+    k_mutex_lock(&_subscribersLock, K_FOREVER);
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&_subscribers, subscriber, node)
+    {
+        if (flags & subscriber->mask)
+        {
+            subscriber->handler(_instance, flags & subscriber->mask);
+        }
+    }
+
+    k_mutex_unlock(&_subscribersLock);
+    openthread_api_mutex_unlock(openthread_get_default_context());
+
+    PERF_PROBE_END(PERF_OT_STATE_CHANGED);
+}
+
+void stateSubscribe(struct stateSubscriber *subscriber)
+{
+    k_mutex_lock(&_subscribersLock, K_FOREVER);
+    sys_slist_append(&_subscribers, &subscriber->node);
+    k_mutex_unlock(&_subscribersLock);
+}
+
+void stateGetStats(struct stateStats *stats)
+{
+    memcpy(stats, &_stats, sizeof(*stats));
+}
+
+int stateInit(otInstance *instance)
+{
+    _instance = instance;
+
+    otError error = otSetStateChangedCallback(instance, stateChanged, NULL);
+    if (error != OT_ERROR_NONE)
+    {
+        LOG_ERR("Failed to register state changed callback (err %d)", error);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+#if defined(CONFIG_SHELL)
+static int stateCmdStats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct stateStats stats;
+    stateGetStats(&stats);
+
+    shell_print(sh, "%-22s %u", "callbacks", stats.callbacks);
+    shell_print(sh, "%-22s %u", "dispatches", stats.dispatches);
+    for (int i = 0; i < ARRAY_SIZE(stats.flags); i++)
+    {
+        if (stats.flags[i])
+        {
+            shell_print(sh, "%-22s %u", stateFlagNames[i], stats.flags[i]);
+        }
+    }
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(state, NULL, "OpenThread state change counts per flag", stateCmdStats);
+#endif
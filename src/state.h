@@ -0,0 +1,38 @@
+#ifndef STATE_H_
+#define STATE_H_
+
+// Includes
+
+#include <stdint.h>
+
+#include <zephyr/sys/slist.h>
+
+#include <openthread/instance.h>
+
+// Definitions
+
+// Called from the system work queue with the OpenThread API lock held,
+// flags holds only the subscribed bits that changed since the last call
+typedef void (*stateHandler)(otInstance *instance, otChangedFlags flags);
+
+struct stateSubscriber
+{
+    otChangedFlags mask;
+    stateHandler handler;
+    sys_snode_t node;
+};
+
+struct stateStats
+{
+    uint32_t callbacks;     // OpenThread state changed callbacks
+    uint32_t dispatches;    // Runs of the deferred work, one per burst
+    uint32_t flags[32];     // Per OT_CHANGED_* bit, indexed by bit position
+};
+
+// Prototypes
+
+int stateInit(otInstance *instance);
+void stateSubscribe(struct stateSubscriber *subscriber);
+void stateGetStats(struct stateStats *stats);
+
+#endif
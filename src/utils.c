@@ -1,13 +1,5 @@
 #include "utils.h"
 
-
-#include <zephyr/drivers/uart.h>
-#include <zephyr/usb/usb_device.h>
-
-#include <openthread/platform/logging.h>
-#include "openthread/instance.h"
-#include "openthread/thread.h"
-
 int8_t datahex(char* string, uint8_t *data, int8_t len) 
 {
     if(string == NULL) 
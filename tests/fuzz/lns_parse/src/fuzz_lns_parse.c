@@ -0,0 +1,106 @@
+// Includes
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lns_parse.h"
+
+// Definitions
+
+// Field sizes in wire order, kept apart from the parser's own table
+static const struct
+{
+    uint16_t flag;
+    uint8_t size;
+} _fieldSizes[] = {
+    { BT_LNS_FLAG_INSTANT_SPEED,  2 },
+    { BT_LNS_FLAG_TOTAL_DISTANCE, 3 },
+    { BT_LNS_FLAG_LOCATION,       8 },
+    { BT_LNS_FLAG_ELEVATION,      3 },
+    { BT_LNS_FLAG_HEADING,        2 },
+    { BT_LNS_FLAG_ROLLING_TIME,   1 },
+    { BT_LNS_FLAG_UTC_TIME,       7 },
+};
+
+#define FUZZ_CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            abort(); \
+        } \
+    } while (0)
+
+// Functions
+
+static size_t fuzzExpectedLength(uint16_t flags)
+{
+    size_t expected = sizeof(flags);
+
+    for (size_t i = 0; i < ARRAY_SIZE(_fieldSizes); i++)
+    {
+        if (flags & _fieldSizes[i].flag)
+        {
+            expected += _fieldSizes[i].size;
+        }
+    }
+
+    return expected;
+}
+
+// Any notification payload: the parser must stay inside it and agree on its length
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    struct ble_lns_loc_speed_s value;
+    struct ble_lns_loc_speed_s untouched;
+
+    if (size > UINT16_MAX)
+    {
+        return 0;
+    }
+
+    memset(&value, 0xa5, sizeof(value));
+    memcpy(&untouched, &value, sizeof(value));
+
+    int err = bt_lns_parse_location_and_speed(data, (uint16_t)size, &value);
+
+    if (size < sizeof(uint16_t))
+    {
+        FUZZ_CHECK(err == -EINVAL);
+        FUZZ_CHECK(memcmp(&value, &untouched, sizeof(value)) == 0);
+        return 0;
+    }
+
+    uint16_t flags = ((uint16_t)data[1] << 8) | data[0];
+    size_t expected = fuzzExpectedLength(flags);
+
+    FUZZ_CHECK(expected <= BT_LNS_LOC_SPEED_MAX_LEN);
+    if (size < expected)
+    {
+        // A short value leaves the previous one alone
+        FUZZ_CHECK(err == -EINVAL);
+        FUZZ_CHECK(memcmp(&value, &untouched, sizeof(value)) == 0);
+        return 0;
+    }
+
+    // Trailing bytes are ignored
+    FUZZ_CHECK(err == 0);
+    FUZZ_CHECK(value.instant_speed_present == !!(flags & BT_LNS_FLAG_INSTANT_SPEED));
+    FUZZ_CHECK(value.total_distance_present == !!(flags & BT_LNS_FLAG_TOTAL_DISTANCE));
+    FUZZ_CHECK(value.location_present == !!(flags & BT_LNS_FLAG_LOCATION));
+    FUZZ_CHECK(value.elevation_present == !!(flags & BT_LNS_FLAG_ELEVATION));
+    FUZZ_CHECK(value.heading_present == !!(flags & BT_LNS_FLAG_HEADING));
+    FUZZ_CHECK(value.rolling_time_present == !!(flags & BT_LNS_FLAG_ROLLING_TIME));
+    FUZZ_CHECK(value.utc_time_time_present == !!(flags & BT_LNS_FLAG_UTC_TIME));
+    FUZZ_CHECK(value.position_status <= 3);
+    FUZZ_CHECK(value.data_format <= 1);
+    FUZZ_CHECK(value.elevation_source <= 3);
+    FUZZ_CHECK(value.heading_source <= 1);
+    FUZZ_CHECK(value.total_distance <= 0xffffff);
+    FUZZ_CHECK(value.elevation >= -0x800000 && value.elevation <= 0x7fffff);
+
+    return 0;
+}
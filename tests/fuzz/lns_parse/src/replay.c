@@ -0,0 +1,49 @@
+// Runs each file given on the command line through the harness, for
+// compilers without libFuzzer
+
+// Includes
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Definitions
+
+#define REPLAY_MAX_SIZE 65536
+
+// Functions
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char **argv)
+{
+    static uint8_t buffer[REPLAY_MAX_SIZE];
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL)
+        {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+
+        size_t size = fread(buffer, 1, sizeof(buffer), file);
+        fclose(file);
+
+        // Exact size copy so the address sanitizer sees reads past the end
+        uint8_t *data = malloc(size ? size : 1);
+        if (data == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+        memcpy(data, buffer, size);
+
+        printf("Running %s (%zu bytes)\n", argv[i], size);
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+// Includes
+
+#include <zephyr/ztest.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+#include <time.h>
+#endif
+
+#include "lns_parse.h"
+#include "payload.h"
+#include "state.h"
+#include "stubs.h"
+#include "utils.h"
+
+// Definitions
+
+#define BENCH_ITERATIONS CONFIG_UNIT_BENCH_ITERATIONS
+
+// Run body BENCH_ITERATIONS times and report one BENCH line, bytes is what one
+// iteration consumes or produces
+#define BENCH(name, bytes, body) \
+    do \
+    { \
+        uint64_t benchStart = benchNowNs(); \
+        for (uint32_t benchIteration = 0; benchIteration < BENCH_ITERATIONS; benchIteration++) \
+        { \
+            body; \
+        } \
+        benchReport(name, benchNowNs() - benchStart, bytes); \
+    } \
+    while (0)
+
+// Globals
+
+// Results go here, so the calls are not optimized away
+static volatile int _sink;
+
+// Functions
+
+// Simulated time stands still while native code runs, use the host clock there
+static uint64_t benchNowNs(void)
+{
+#if defined(CONFIG_ARCH_POSIX)
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+#else
+    return k_cyc_to_ns_floor64(k_cycle_get_32());
+#endif
+}
+
+// One JSON object per line, collected by scripts/bench_report.py
+static void benchReport(const char *name, uint64_t ns, uint32_t bytes)
+{
+    uint64_t psPerOp = ns * 1000 / BENCH_ITERATIONS;
+
+    printk("BENCH {\"name\":\"%s\",\"iterations\":%u,\"ns_per_op\":%llu.%03llu,"
+        "\"bytes_per_op\":%u}\n", name, BENCH_ITERATIONS, (unsigned long long)(psPerOp / 1000),
+        (unsigned long long)(psPerOp % 1000), bytes);
+}
+
+ZTEST(bench, test_datahex)
+{
+    char key[] = "33:33:44:44:33:33:44:44:33:33:44:44:33:33:44:44";
+    uint8_t data[16];
+
+    BENCH("datahex", sizeof(data), _sink = datahex(key, data, sizeof(data)));
+    zassert_equal(_sink, 33);
+}
+
+ZTEST(bench, test_payload)
+{
+    static struct payloadRecord records[PAYLOAD_BATCH_MAX];
+    static uint8_t buf[PAYLOAD_BATCH_MAX * PAYLOAD_MAX_SIZE];
+    struct payloadDiag diag = { .uptime = 86400, .published = 12345 };
+    int len;
+
+    for (size_t i = 0; i < ARRAY_SIZE(records); i++)
+    {
+        records[i] = (struct payloadRecord){
+            .id = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 },
+            .count = 1000 + i,
+            .status = "P1",
+            .battery = 87,
+            .latitude = 599000000 + i * 13,
+            .longitude = 108000000 - i * 7,
+            .elevation = 3512,
+            .temperature = 2150,
+            .peer = { 0xc0, 0x11, 0x22, 0x33, 0x44, 0x55 },
+        };
+    }
+
+    len = payloadEncodeCbor(&records[0], buf, sizeof(buf));
+    zassert_true(len > 0);
+    BENCH("payload_cbor", len, _sink = payloadEncodeCbor(&records[0], buf, sizeof(buf)));
+
+    len = payloadEncodeJson(&records[0], buf, sizeof(buf));
+    zassert_true(len > 0);
+    BENCH("payload_json", len, _sink = payloadEncodeJson(&records[0], buf, sizeof(buf)));
+
+    len = payloadEncodeBatch(records, ARRAY_SIZE(records), buf, sizeof(buf));
+    zassert_true(len > 0);
+    BENCH("payload_batch", len,
+        _sink = payloadEncodeBatch(records, ARRAY_SIZE(records), buf, sizeof(buf)));
+
+    len = payloadEncodeDiag(&diag, buf, sizeof(buf));
+    zassert_true(len > 0);
+    BENCH("payload_diag", len, _sink = payloadEncodeDiag(&diag, buf, sizeof(buf)));
+}
+
+ZTEST(bench, test_lns_parse)
+{
+    // Every optional field, the longest value a tag sends
+    const uint8_t full[BT_LNS_LOC_SPEED_MAX_LEN] = {
+        0x7f, 0x17, 0x34, 0x12, 0x56, 0x34, 0x12, 0xc0, 0x03, 0xb4, 0x23, 0x00, 0xf3, 0x6f,
+        0x06, 0x2e, 0xfb, 0xff, 0x10, 0x27, 0x05, 0xea, 0x07, 0x0a, 0x10, 0x0c, 0x22, 0x38,
+    };
+    // Location and elevation, what the tags send by default
+    const uint8_t location[] = {
+        0x0c, 0x00, 0xc0, 0x03, 0xb4, 0x23, 0x00, 0xf3, 0x6f, 0x06, 0x2e, 0xfb, 0xff,
+    };
+    struct ble_lns_loc_speed_s value;
+
+    BENCH("lns_parse_full", sizeof(full),
+        _sink = bt_lns_parse_location_and_speed(full, sizeof(full), &value));
+    zassert_equal(_sink, 0);
+
+    BENCH("lns_parse_location", sizeof(location),
+        _sink = bt_lns_parse_location_and_speed(location, sizeof(location), &value));
+    zassert_equal(_sink, 0);
+}
+
+// The part of the state handling that runs in the OpenThread thread, the
+// dispatch itself runs once for the whole loop
+ZTEST(bench, test_state_changed)
+{
+    struct stateStats stats;
+
+    zassert_ok(stateInit(NULL));
+
+    k_sched_lock();
+    BENCH("state_changed", 0,
+        stubStateChanged(OT_CHANGED_THREAD_NETDATA | OT_CHANGED_IP6_ADDRESS_ADDED |
+            OT_CHANGED_THREAD_RLOC_ADDED));
+    k_sched_unlock();
+    k_sleep(K_MSEC(1));
+
+    stateGetStats(&stats);
+    zassert_true(stats.flags[9] >= BENCH_ITERATIONS);
+}
+
+ZTEST_SUITE(bench, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,61 @@
+#include "stubs.h"
+
+// Includes
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/openthread.h>
+
+// Globals
+
+static otStateChangedCallback _callback;
+static void *_callbackContext;
+static struct openthread_context _context;
+static int _lockDepth;
+
+// Functions
+
+otError otSetStateChangedCallback(otInstance *aInstance, otStateChangedCallback aCallback,
+    void *aContext)
+{
+    ARG_UNUSED(aInstance);
+
+    _callback = aCallback;
+    _callbackContext = aContext;
+
+    return OT_ERROR_NONE;
+}
+
+struct openthread_context *openthread_get_default_context(void)
+{
+    return &_context;
+}
+
+otInstance *openthread_get_default_instance(void)
+{
+    return _context.instance;
+}
+
+void openthread_api_mutex_lock(struct openthread_context *ot_context)
+{
+    ARG_UNUSED(ot_context);
+    _lockDepth++;
+}
+
+void openthread_api_mutex_unlock(struct openthread_context *ot_context)
+{
+    ARG_UNUSED(ot_context);
+    _lockDepth--;
+}
+
+void stubStateChanged(otChangedFlags flags)
+{
+    if (_callback)
+    {
+        _callback(flags, _callbackContext);
+    }
+}
+
+int stubApiLockDepth(void)
+{
+    return _lockDepth;
+}
@@ -0,0 +1,16 @@
+#ifndef STUBS_H_
+#define STUBS_H_
+
+// Includes
+
+#include <openthread/instance.h>
+
+// Prototypes
+
+// Deliver a state change the way the OpenThread thread would
+void stubStateChanged(otChangedFlags flags);
+
+// Nesting depth of openthread_api_mutex_lock()
+int stubApiLockDepth(void);
+
+#endif
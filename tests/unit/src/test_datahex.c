@@ -0,0 +1,43 @@
+// Includes
+
+#include <zephyr/ztest.h>
+
+#include "utils.h"
+
+// Functions
+
+ZTEST(datahex, test_colon_separated)
+{
+    char string[] = "33:33:33:33:44:44:44:4f";
+    const uint8_t expected[] = { 0x33, 0x33, 0x33, 0x33, 0x44, 0x44, 0x44, 0x4f };
+    uint8_t data[8];
+
+    zassert_equal(datahex(string, data, sizeof(data)), 17, "one more than the digits");
+    zassert_mem_equal(data, expected, sizeof(expected));
+}
+
+ZTEST(datahex, test_plain_mixed_case)
+{
+    char string[] = "00fFaB";
+    const uint8_t expected[] = { 0x00, 0xff, 0xab, 0x00 };
+    uint8_t data[4];
+
+    memset(data, 0x55, sizeof(data));
+    zassert_equal(datahex(string, data, sizeof(data)), 7);
+    zassert_mem_equal(data, expected, sizeof(expected), "short input is zero padded");
+}
+
+ZTEST(datahex, test_rejects)
+{
+    char odd[] = "123";
+    char invalid[] = "12g4";
+    char tooLong[] = "0102030405";
+    uint8_t data[4];
+
+    zassert_equal(datahex(NULL, data, sizeof(data)), -1);
+    zassert_equal(datahex(odd, data, sizeof(data)), -1);
+    zassert_equal(datahex(invalid, data, sizeof(data)), -1);
+    zassert_equal(datahex(tooLong, data, sizeof(data)), -1);
+}
+
+ZTEST_SUITE(datahex, NULL, NULL, NULL, NULL, NULL);
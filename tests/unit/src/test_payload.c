@@ -0,0 +1,153 @@
+// Includes
+
+#include <zephyr/ztest.h>
+
+#include "payload.h"
+
+// Definitions
+
+// Same record as in the vectors below, generated with scripts/payload_decode.py
+#define TEST_RECORD \
+    { \
+        .id = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 }, \
+        .count = 42, \
+        .status = "P1", \
+        .battery = 87, \
+        .latitude = 599000000, \
+        .longitude = 108000000, \
+        .elevation = -1234, \
+        .temperature = -250, \
+        .peer = { 0xc0, 0x11, 0x22, 0x33, 0x44, 0x55 }, \
+    }
+
+// Globals
+
+static const struct payloadRecord _record = TEST_RECORD;
+
+// encode() in scripts/payload_decode.py
+static const uint8_t _recordCbor[] = {
+    0xA9, 0x00, 0x48, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x01, 0x18, 0x2A, 0x02, 0x62,
+    0x50, 0x31, 0x03, 0x18, 0x57, 0x04, 0x1A, 0x23, 0xB4, 0x03, 0xC0, 0x05, 0x1A, 0x06, 0x6F, 0xF3,
+    0x00, 0x06, 0x39, 0x04, 0xD1, 0x07, 0x38, 0xF9, 0x0A, 0x46, 0xC0, 0x11, 0x22, 0x33, 0x44, 0x55,
+};
+
+// encode_batch() of the record and a copy with count + 1 and latitude + 10
+static const uint8_t _batchCbor[] = {
+    0xA2, 0x00, 0x48, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x08, 0x82, 0x88, 0x18, 0x2A,
+    0x62, 0x50, 0x31, 0x18, 0x57, 0x1A, 0x23, 0xB4, 0x03, 0xC0, 0x1A, 0x06, 0x6F, 0xF3, 0x00, 0x39,
+    0x04, 0xD1, 0x38, 0xF9, 0x46, 0xC0, 0x11, 0x22, 0x33, 0x44, 0x55, 0x88, 0x01, 0xF6, 0x00, 0x0A,
+    0x00, 0x00, 0x00, 0xF6,
+};
+
+// encode_json() in scripts/payload_decode.py
+static const char _recordJson[] = "{\"id\":\"0102030405060708\",\"count\":42,\"status\":\"P1\","
+    "\"batt\":87,\"lat\":599000000,\"lon\":108000000,\"ele\":-1234,\"temp\":-2.50,"
+    "\"peer\":\"5544332211c0\"}";
+
+// Functions
+
+ZTEST(payload, test_cbor_matches_host_encoder)
+{
+    uint8_t buf[PAYLOAD_MAX_SIZE];
+
+    zassert_equal(payloadEncodeCbor(&_record, buf, sizeof(buf)), sizeof(_recordCbor));
+    zassert_mem_equal(buf, _recordCbor, sizeof(_recordCbor));
+}
+
+ZTEST(payload, test_cbor_overflow)
+{
+    uint8_t buf[PAYLOAD_MAX_SIZE];
+
+    for (size_t size = 0; size < sizeof(_recordCbor); size++)
+    {
+        zassert_equal(payloadEncodeCbor(&_record, buf, size), -1, "size %zu", size);
+    }
+}
+
+ZTEST(payload, test_json_matches_host_encoder)
+{
+    uint8_t buf[PAYLOAD_MAX_SIZE];
+
+    zassert_equal(payloadEncodeJson(&_record, buf, sizeof(buf)), strlen(_recordJson));
+    zassert_mem_equal(buf, _recordJson, sizeof(_recordJson));
+
+    // The terminator has to fit as well
+    zassert_equal(payloadEncodeJson(&_record, buf, strlen(_recordJson)), -1);
+}
+
+ZTEST(payload, test_json_largest_record_fits)
+{
+    // Widest value of every field the node can report
+    const struct payloadRecord record = {
+        .id = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+        .count = UINT32_MAX,
+        .status = { 'A', 'B', 'C', 'D' },
+        .battery = 100,
+        .latitude = -900000000,
+        .longitude = -1800000000,
+        .elevation = -8388608,
+        .temperature = INT16_MIN,
+        .peer = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+    };
+    uint8_t buf[PAYLOAD_MAX_SIZE];
+
+    zassert_true(payloadEncodeJson(&record, buf, sizeof(buf)) > 0);
+}
+
+ZTEST(payload, test_batch)
+{
+    struct payloadRecord records[2] = { TEST_RECORD, TEST_RECORD };
+    uint8_t buf[2 * PAYLOAD_MAX_SIZE + 2];
+
+    records[1].count++;
+    records[1].latitude += 10;
+
+    zassert_equal(payloadEncodeBatch(records, 0, buf, sizeof(buf)), -1);
+    zassert_equal(payloadEncodeBatch(records, PAYLOAD_BATCH_MAX + 1, buf, sizeof(buf)), -1);
+
+    int len = payloadEncodeBatch(records, ARRAY_SIZE(records), buf, sizeof(buf));
+
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_CBOR)
+    zassert_equal(len, sizeof(_batchCbor));
+    zassert_mem_equal(buf, _batchCbor, sizeof(_batchCbor));
+#else
+    zassert_equal(len, 2 * strlen(_recordJson) + 3, "two records, brackets and separator");
+    zassert_equal(buf[0], '[');
+    zassert_equal(buf[strlen(_recordJson) + 1], ',');
+    zassert_equal(buf[len - 1], ']');
+#endif
+
+    zassert_equal(payloadEncodeBatch(records, ARRAY_SIZE(records), buf, len - 1), -1);
+}
+
+ZTEST(payload, test_diag)
+{
+    const struct payloadDiag diag = {
+        .id = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 },
+        .uptime = 3600,
+        .published = 100,
+        .failed = 1,
+        .retransmits = 2,
+        .searches = 3,
+        .stored = 0,
+    };
+    uint8_t buf[PAYLOAD_MAX_SIZE];
+
+    int len = payloadEncodeDiag(&diag, buf, sizeof(buf));
+
+    zassert_true(len > 0);
+    zassert_equal(payloadEncodeDiag(&diag, buf, len - 1), -1);
+
+#if defined(CONFIG_MQTT_SNCLIENT_PAYLOAD_CBOR)
+    // { 0: h'0102030405060708', 9: [3600, 100, 1, 2, 3, 0] }
+    const uint8_t expected[] = {
+        0xA2, 0x00, 0x48, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x86, 0x19, 0x0E,
+        0x10, 0x18, 0x64, 0x01, 0x02, 0x03, 0x00,
+    };
+
+    zassert_equal(len, sizeof(expected));
+    zassert_mem_equal(buf, expected, sizeof(expected));
+#endif
+}
+
+ZTEST_SUITE(payload, NULL, NULL, NULL, NULL, NULL);
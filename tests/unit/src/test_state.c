@@ -0,0 +1,143 @@
+// Includes
+
+#include <zephyr/ztest.h>
+
+#include "state.h"
+#include "stubs.h"
+
+// Definitions
+
+struct testSubscriber
+{
+    struct stateSubscriber subscriber;
+    uint32_t calls;
+    otChangedFlags flags;
+    int lockDepth;
+};
+
+// Globals
+
+static struct testSubscriber _role;
+static struct testSubscriber _netdata;
+static struct testSubscriber _child;
+
+// Functions
+
+static void testRecord(struct testSubscriber *test, otChangedFlags flags)
+{
+    test->calls++;
+    test->flags |= flags;
+    test->lockDepth = stubApiLockDepth();
+}
+
+static void testRoleChanged(otInstance *instance, otChangedFlags flags)
+{
+    testRecord(&_role, flags);
+}
+
+static void testNetdataChanged(otInstance *instance, otChangedFlags flags)
+{
+    testRecord(&_netdata, flags);
+}
+
+static void testChildChanged(otInstance *instance, otChangedFlags flags)
+{
+    testRecord(&_child, flags);
+}
+
+// Let the system work queue run the dispatch
+static void testDispatch(void)
+{
+    k_sleep(K_MSEC(1));
+}
+
+ZTEST(state, test_burst_coalesced)
+{
+    struct stateStats before;
+    struct stateStats after;
+
+    stateGetStats(&before);
+
+    // Three callbacks before the work queue gets to run
+    k_sched_lock();
+    stubStateChanged(OT_CHANGED_THREAD_ROLE);
+    stubStateChanged(OT_CHANGED_THREAD_NETDATA | OT_CHANGED_IP6_ADDRESS_ADDED);
+    stubStateChanged(OT_CHANGED_IP6_ADDRESS_ADDED);
+    k_sched_unlock();
+    testDispatch();
+
+    stateGetStats(&after);
+
+    zassert_equal(after.callbacks - before.callbacks, 3);
+    zassert_equal(after.dispatches - before.dispatches, 1, "one dispatch per burst");
+    zassert_equal(after.flags[2] - before.flags[2], 1);
+    zassert_equal(after.flags[9] - before.flags[9], 1);
+    zassert_equal(after.flags[0] - before.flags[0], 2, "every occurrence is counted");
+
+    zassert_equal(_role.calls, 1);
+    zassert_equal(_role.flags, OT_CHANGED_THREAD_ROLE, "only the subscribed bits");
+    zassert_equal(_netdata.calls, 1);
+    zassert_equal(_netdata.flags, OT_CHANGED_THREAD_ROLE | OT_CHANGED_THREAD_NETDATA);
+    zassert_equal(_child.calls, 0);
+}
+
+ZTEST(state, test_handlers_hold_api_lock)
+{
+    stubStateChanged(OT_CHANGED_THREAD_CHILD_ADDED);
+    testDispatch();
+
+    zassert_equal(_child.calls, 1);
+    zassert_equal(_child.lockDepth, 1);
+    zassert_equal(stubApiLockDepth(), 0, "released after the dispatch");
+}
+
+ZTEST(state, test_separate_bursts)
+{
+    stubStateChanged(OT_CHANGED_THREAD_ROLE);
+    testDispatch();
+    stubStateChanged(OT_CHANGED_THREAD_ROLE);
+    testDispatch();
+
+    zassert_equal(_role.calls, 2);
+}
+
+ZTEST(state, test_no_flags)
+{
+    struct stateStats before;
+    struct stateStats after;
+
+    stateGetStats(&before);
+    stubStateChanged(0);
+    testDispatch();
+    stateGetStats(&after);
+
+    zassert_equal(after.dispatches, before.dispatches);
+    zassert_equal(_role.calls + _netdata.calls + _child.calls, 0);
+}
+
+static void *stateSetup(void)
+{
+    _role.subscriber.mask = OT_CHANGED_THREAD_ROLE;
+    _role.subscriber.handler = testRoleChanged;
+    _netdata.subscriber.mask = OT_CHANGED_THREAD_ROLE | OT_CHANGED_THREAD_NETDATA;
+    _netdata.subscriber.handler = testNetdataChanged;
+    _child.subscriber.mask = OT_CHANGED_THREAD_CHILD_ADDED;
+    _child.subscriber.handler = testChildChanged;
+
+    stateSubscribe(&_role.subscriber);
+    stateSubscribe(&_netdata.subscriber);
+    stateSubscribe(&_child.subscriber);
+    zassert_ok(stateInit(NULL));
+
+    return NULL;
+}
+
+static void stateBefore(void *fixture)
+{
+    ARG_UNUSED(fixture);
+
+    _role.calls = _netdata.calls = _child.calls = 0;
+    _role.flags = _netdata.flags = _child.flags = 0;
+}
+
+ZTEST_SUITE(state, NULL, stateSetup, stateBefore, NULL, NULL);
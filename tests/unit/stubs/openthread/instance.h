@@ -0,0 +1,38 @@
+// Subset of the OpenThread instance API used by the modules under test,
+// flag values as in openthread/instance.h
+
+#ifndef OPENTHREAD_INSTANCE_H_
+#define OPENTHREAD_INSTANCE_H_
+
+#include <stdint.h>
+
+typedef struct otInstance otInstance;
+
+typedef enum
+{
+    OT_ERROR_NONE = 0,
+    OT_ERROR_FAILED = 1,
+    OT_ERROR_INVALID_ARGS = 7,
+} otError;
+
+typedef uint32_t otChangedFlags;
+typedef void (*otStateChangedCallback)(otChangedFlags aFlags, void *aContext);
+
+#define OT_CHANGED_IP6_ADDRESS_ADDED (1U << 0)
+#define OT_CHANGED_IP6_ADDRESS_REMOVED (1U << 1)
+#define OT_CHANGED_THREAD_ROLE (1U << 2)
+#define OT_CHANGED_THREAD_LL_ADDR (1U << 3)
+#define OT_CHANGED_THREAD_ML_ADDR (1U << 4)
+#define OT_CHANGED_THREAD_RLOC_ADDED (1U << 5)
+#define OT_CHANGED_THREAD_RLOC_REMOVED (1U << 6)
+#define OT_CHANGED_THREAD_PARTITION_ID (1U << 7)
+#define OT_CHANGED_THREAD_KEY_SEQUENCE_COUNTER (1U << 8)
+#define OT_CHANGED_THREAD_NETDATA (1U << 9)
+#define OT_CHANGED_THREAD_CHILD_ADDED (1U << 10)
+#define OT_CHANGED_THREAD_CHILD_REMOVED (1U << 11)
+#define OT_CHANGED_ACTIVE_DATASET (1U << 28)
+
+otError otSetStateChangedCallback(otInstance *aInstance, otStateChangedCallback aCallback,
+    void *aContext);
+
+#endif
@@ -0,0 +1,18 @@
+// Stands in for the Zephyr OpenThread L2, only the API lock is used
+
+#ifndef ZEPHYR_NET_OPENTHREAD_H_
+#define ZEPHYR_NET_OPENTHREAD_H_
+
+#include <openthread/instance.h>
+
+struct openthread_context
+{
+    otInstance *instance;
+};
+
+struct openthread_context *openthread_get_default_context(void);
+otInstance *openthread_get_default_instance(void);
+void openthread_api_mutex_lock(struct openthread_context *ot_context);
+void openthread_api_mutex_unlock(struct openthread_context *ot_context);
+
+#endif